@@ -0,0 +1,481 @@
+/* This code is under MIT license.
+   See https://opensource.org/licenses/MIT
+
+   Benchmarks of cmdline_parser.h: schema construction, parse latency and throughput, help
+   rendering and error paths, for schemas of 5 to 100,000 options and command lines of 1 to
+   1,000,000 arguments.
+
+   Build and run (the library is header only):
+
+       g++ -std=c++17 -O2 -DNDEBUG -pthread -Iinclude bench/cmdline_parser_bench.cpp -o cmdline_parser_bench
+       ./cmdline_parser_bench > bench_output.txt
+
+   The output is CSV, one line per measure, with stable columns so that two runs can be diffed:
+   benchmark,options,argc,iterations,ns_per_op,ns_per_arg,allocs_per_op
+
+   Parsing into a warm ParseResult and looking values up must not allocate: the program exits with
+   status 1 if one of these measures reports an allocation.
+*/
+#ifndef NDEBUG
+#error "benchmarks must be built with -DNDEBUG (assertions distort the measures)"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cmdline_parser.h"
+
+// the replacements below pair malloc/free correctly, but GCC warns once they are inlined
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+    std::atomic<size_t> allocationCount{ 0 }; // operator new runs on the parseBatch() threads too
+    bool allocationBudgetExceeded = false;
+}
+
+void * operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void * p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+void * operator new(size_t size, std::align_val_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    const size_t align = static_cast<size_t>(alignment);
+    if (void * p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void * operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+void operator delete[](void * p) noexcept {
+    std::free(p);
+}
+void operator delete(void * p, size_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void * p, size_t) noexcept {
+    std::free(p);
+}
+void operator delete(void * p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void * p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void * p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void * p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    const size_t schemaSizes[] = { 5, 100, 1000, 10000, 100000 };
+    const size_t argcs[] = { 1, 10, 1000, 100000, 1000000 };
+
+    // discards what help rendering writes to std::cout
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+    };
+
+    // "options" options: "--o<i> o<i>" taking a value, and a last "--flag"
+    std::vector<cmdline::ProgramOption> makeOptions(size_t options) {
+        std::vector<cmdline::ProgramOption> result;
+        result.reserve(options);
+        result.push_back({ "help", "Benchmark program" });
+        for (size_t i = 1; i + 1 < options; ++i) {
+            result.push_back({ { "--o" + std::to_string(i), "o" + std::to_string(i) }, "Option " + std::to_string(i), "default" });
+        }
+        result.push_back({ { "--flag" }, "Boolean flag" });
+        return result;
+    }
+
+    // argv cycling over the value options, pointing into strings owned by the CommandLine
+    struct CommandLine {
+        std::vector<std::string> strings;
+        std::vector<char *> argv;
+
+        CommandLine(size_t options, size_t argc) {
+            const size_t valueOptions = options - 2;
+            strings.push_back("bench");
+            strings.push_back("--flag");
+            strings.push_back("value");
+            for (size_t i = 1; i <= valueOptions; ++i) {
+                strings.push_back("--o" + std::to_string(i));
+            }
+            argv.reserve(argc + 1);
+            argv.push_back(&strings[0][0]);
+            for (size_t i = 0; argv.size() < argc; ++i) {
+                if (argv.size() + 1 == argc) {
+                    argv.push_back(&strings[1][0]);
+                }
+                else {
+                    argv.push_back(&strings[3 + i % valueOptions][0]);
+                    argv.push_back(&strings[2][0]);
+                }
+            }
+            argv.push_back(nullptr);
+        }
+
+        int argc() const { return static_cast<int>(argv.size() - 1); }
+        char ** data() { return argv.data(); }
+    };
+
+    // repeat op for at least minDuration, then print a CSV line; return the allocation count
+    template <class Op>
+    size_t measure(const char * name, size_t options, size_t argc, Op && op) {
+        using Clock = std::chrono::steady_clock;
+        const auto minDuration = std::chrono::milliseconds(100);
+
+        op(); // warm up
+        size_t iterations = 0;
+        const size_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        const auto start = Clock::now();
+        auto elapsed = Clock::duration::zero();
+        do {
+            op();
+            ++iterations;
+            elapsed = Clock::now() - start;
+        } while (elapsed < minDuration);
+        const size_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+        const double ns = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+        const double nsPerArg = (argc > 1) ? ns / static_cast<double>(argc - 1) : 0.0;
+        std::printf("%s,%zu,%zu,%zu,%.1f,%.2f,%.2f\n", name, options, argc, iterations, ns, nsPerArg,
+                    static_cast<double>(allocations) / static_cast<double>(iterations));
+        std::fflush(stdout);
+        return allocations;
+    }
+
+    // for the steady state paths, which must not allocate at all
+    template <class Op>
+    void measureWithoutAllocation(const char * name, size_t options, size_t argc, Op && op) {
+        if (measure(name, options, argc, op) != 0) {
+            std::fprintf(stderr, "error: %s allocates (options=%zu, argc=%zu)\n", name, options, argc);
+            allocationBudgetExceeded = true;
+        }
+    }
+
+    volatile size_t sink = 0;
+
+    void benchSchemaConstruction() {
+        for (const size_t options : schemaSizes) {
+            const auto list = makeOptions(options);
+            measure("schema_build", options, 0, [&] {
+                const cmdline::Parser parser(list);
+                sink = sink + parser.option("--flag").index;
+            });
+        }
+    }
+
+    void benchParse() {
+        for (const size_t options : schemaSizes) {
+            const cmdline::Parser parser(makeOptions(options));
+            for (const size_t argc : argcs) {
+                CommandLine commandLine(options, argc);
+                cmdline::ParseResult result;
+                measureWithoutAllocation("parse_warm", options, argc, [&] {
+                    parser.tryParse(commandLine.argc(), commandLine.data(), result);
+                    sink = sink + result.values[cmdline::OptionHandle{ 1 }].size();
+                });
+                measure("parse_cold", options, argc, [&] {
+                    const cmdline::ParseResult fresh = parser.tryParse(commandLine.argc(), commandLine.data());
+                    sink = sink + fresh.values[cmdline::OptionHandle{ 1 }].size();
+                });
+            }
+        }
+    }
+
+    void benchLookup() {
+        for (const size_t options : schemaSizes) {
+            const cmdline::Parser parser(makeOptions(options));
+            CommandLine commandLine(options, 3);
+            cmdline::ParseResult result;
+            parser.tryParse(commandLine.argc(), commandLine.data(), result);
+            const std::string key = "o" + std::to_string(options / 2);
+            measureWithoutAllocation("lookup_key", options, 0, [&] {
+                sink = sink + result.values[key].size();
+            });
+            measureWithoutAllocation("lookup_handle", options, 0, [&] {
+                sink = sink + parser.option(key).index;
+            });
+        }
+    }
+
+    void benchStaticSchema() {
+        static constexpr cmdline::StaticOption options[] = {
+            { "help", "Benchmark program" },
+            { { "--o1", "o1" }, "Option 1", "default" },
+            { { "--o2", "o2" }, "Option 2", "default" },
+            { { "--o3", "o3" }, "Option 3", "default" },
+            { { "--flag" }, "Boolean flag" }
+        };
+        static constexpr cmdline::StaticSchema<options> schema;
+        for (const size_t argc : argcs) {
+            CommandLine commandLine(5, argc);
+            cmdline::ParseResult result;
+            measureWithoutAllocation("parse_static", 5, argc, [&] {
+                schema.tryParse(commandLine.argc(), commandLine.data(), result);
+                sink = sink + result.values[cmdline::OptionHandle{ 1 }].size();
+            });
+        }
+    }
+
+    void benchVariadic() {
+        const cmdline::Parser parser({ { "help", "Benchmark program" }, { { "--flag" }, "Boolean flag" }, { "inputs...", "Input files" } });
+        const cmdline::OptionHandle inputs = parser.option("inputs");
+        std::string input = "input.txt";
+        for (const size_t argc : argcs) {
+            if (argc < 2) {
+                continue;
+            }
+            std::vector<char *> argv(argc, &input[0]);
+            cmdline::ParseResult result;
+            measureWithoutAllocation("parse_variadic", 3, argc, [&] {
+                parser.tryParse(static_cast<int>(argc), argv.data(), result);
+                for (const std::string_view value : result.values.list(inputs)) {
+                    sink = sink + value.size();
+                }
+            });
+        }
+    }
+
+    void benchRepeated() {
+        const cmdline::Parser parser({ { "help", "Benchmark program" }, { { "-I", "include..." }, "Include path" }, { { "-D", "define..." }, "Macro definition" } });
+        const cmdline::OptionHandle includes = parser.option("include");
+        std::string include = "-I", define = "-D", value = "value";
+        for (const size_t argc : argcs) {
+            if (argc < 3) {
+                continue;
+            }
+            // "-I value -D value..." interleaves the values of both options
+            std::vector<char *> argv(argc, &value[0]);
+            for (size_t i = 1; i + 1 < argc; i += 2) {
+                argv[i] = ((i / 2) % 2 == 0) ? &include[0] : &define[0];
+            }
+            const int usedArgc = static_cast<int>(argc - (argc - 1) % 2);
+            cmdline::ParseResult result;
+            measureWithoutAllocation("parse_repeated", 3, argc, [&] {
+                parser.tryParse(usedArgc, argv.data(), result);
+                sink = sink + result.values.list(includes).size();
+            });
+        }
+    }
+
+    // options of a schema set through an environment of 100 variables, half of them matching
+    void benchEnvironment() {
+        for (const size_t options : schemaSizes) {
+            const cmdline::Parser parser(makeOptions(options));
+            std::vector<std::string> strings;
+            for (size_t i = 0; i < 100; ++i) {
+                strings.push_back(((i % 2) ? "OTHER_O" : "BENCH_O") + std::to_string(i % (options - 2) + 1) + "=value");
+            }
+            std::vector<char *> variables;
+            for (auto & variable : strings) {
+                variables.push_back(&variable[0]);
+            }
+            variables.push_back(nullptr);
+            const cmdline::Environment environment{ "BENCH_", variables.data() };
+            CommandLine commandLine(options, 1);
+            cmdline::ParseResult result;
+            measureWithoutAllocation("parse_environment", options, 1, [&] {
+                parser.tryParse(commandLine.argc(), commandLine.data(), environment, result);
+                sink = sink + result.values[cmdline::OptionHandle{ 1 }].size();
+            });
+        }
+    }
+
+    // half of the settings are already set by the environment: they are skipped without conversion
+    void benchLayers() {
+        for (const size_t options : schemaSizes) {
+            const cmdline::Parser parser(makeOptions(options));
+            std::vector<std::string> strings, keys;
+            for (size_t i = 0; i < 100; ++i) {
+                strings.push_back("BENCH_O" + std::to_string(i % (options - 2) + 1) + "=value");
+                keys.push_back("o" + std::to_string((i + 50) % (options - 2) + 1));
+            }
+            std::vector<char *> variables;
+            for (size_t i = 0; i < strings.size(); i += 2) {
+                variables.push_back(&strings[i][0]);
+            }
+            variables.push_back(nullptr);
+            const cmdline::Environment environment{ "BENCH_", variables.data() };
+            cmdline::Settings settings;
+            for (size_t i = 0; i < keys.size(); ++i) {
+                settings.add(keys[i], "setting", static_cast<int>(i + 1));
+            }
+            CommandLine commandLine(options, 1);
+            cmdline::ParseResult result;
+            measureWithoutAllocation("parse_layers", options, 1, [&] {
+                parser.tryParse(commandLine.argc(), commandLine.data(), cmdline::Layers{ &environment, &settings }, result);
+                sink = sink + result.values[cmdline::OptionHandle{ 1 }].size();
+            });
+        }
+    }
+
+    // a configuration file of up to several MB, loaded then used as the lowest layer
+    void benchConfigFile() {
+        const size_t options = 1000;
+        const cmdline::Parser parser(makeOptions(options));
+        const std::string path = (std::filesystem::temp_directory_path() / "cmdline_parser_bench.ini").string();
+        for (const size_t lines : { size_t(10), size_t(1000), size_t(100000) }) {
+            {
+                std::ofstream file(path, std::ios::binary);
+                for (size_t i = 0; i < lines; ++i) {
+                    file << "o" << (i % (options - 2) + 1) << " = value of setting " << i << "\n";
+                }
+            }
+            cmdline::ConfigFile config;
+            measureWithoutAllocation("config_load", options, lines, [&] {
+                config.tryLoad(path);
+                sink = sink + config.size();
+            });
+            CommandLine commandLine(options, 1);
+            cmdline::ParseResult result;
+            measureWithoutAllocation("parse_config", options, lines, [&] {
+                parser.tryParse(commandLine.argc(), commandLine.data(), cmdline::Layers{ nullptr, &config }, result);
+                sink = sink + result.values[cmdline::OptionHandle{ 1 }].size();
+            });
+        }
+        std::remove(path.c_str());
+    }
+
+    // a read of the shared snapshot, then the snapshot replaced while nobody reads it
+    void benchLiveOptions() {
+        const size_t options = 100;
+        const cmdline::Parser parser(makeOptions(options));
+        CommandLine commandLine(options, 11);
+        const auto makeSnapshot = [&] {
+            auto snapshot = std::make_unique<cmdline::OptionSnapshot>();
+            parser.tryParse(commandLine.argc(), commandLine.data(), snapshot->result);
+            return std::unique_ptr<const cmdline::OptionSnapshot>(std::move(snapshot));
+        };
+        cmdline::LiveOptions live(makeSnapshot());
+        const cmdline::LiveOptions::Reader reader = live.reader();
+        measureWithoutAllocation("live_read", options, 1, [&] {
+            const auto values = reader.read();
+            sink = sink + (*values)[cmdline::OptionHandle{ 1 }].size();
+        });
+        measure("live_publish", options, 11, [&] {
+            sink = sink + live.publish(makeSnapshot()).size();
+        });
+    }
+
+    // two flags looked for before the options are known, the second one not given
+    void benchPrescan() {
+        for (const size_t argc : { size_t(1), size_t(101), size_t(10001) }) {
+            CommandLine commandLine(100, argc);
+            measureWithoutAllocation("prescan", 100, argc, [&] {
+                const auto matches = cmdline::prescan(commandLine.argc(), commandLine.data(), { "--o1", "--config" });
+                sink = sink + matches[0].value.size() + matches[1].value.size();
+            });
+        }
+    }
+
+    void benchCommands() {
+        std::vector<cmdline::Command> commandList;
+        for (size_t i = 0; i < 80; ++i) {
+            commandList.push_back({ "command" + std::to_string(i), "Command " + std::to_string(i), [] { return makeOptions(100); } });
+        }
+        cmdline::Commands commands({ { "help", "Benchmark program" }, { { "--verbose" }, "Verbose" } }, commandList);
+        std::string bench = "bench", verbose = "--verbose", command = "command42", option = "--o1", value = "value";
+        char * argv[] = { &bench[0], &verbose[0], &command[0], &option[0], &value[0], nullptr };
+        cmdline::CommandResult result;
+        measureWithoutAllocation("parse_command", 100, 5, [&] {
+            commands.tryParse(5, argv, result);
+            sink = sink + result.command;
+        });
+    }
+
+    // same lines parsed on 1, 2, 4... threads: the time per op should drop with the thread count
+    // up to the number of cores
+    void benchBatch() {
+        const size_t options = 100, lineCount = 20000, argc = 11;
+        const cmdline::Parser parser(makeOptions(options));
+        CommandLine commandLine(options, argc);
+        const std::vector<std::string_view> line(commandLine.argv.begin(), commandLine.argv.end() - 1);
+        const std::vector<std::vector<std::string_view>> lines(lineCount, line);
+        std::vector<cmdline::ParseResult> results(lineCount);
+        const unsigned cores = (std::max)(2u, std::thread::hardware_concurrency());
+        for (unsigned threads = 1; threads <= cores; threads *= 2) {
+            const std::string name = "parse_batch_" + std::to_string(threads) + "_threads";
+            measure(name.c_str(), options, lineCount * argc, [&] {
+                sink = sink + parser.parseBatch(lines, results.data(), threads);
+            });
+        }
+    }
+
+    void benchHelp() {
+        NullBuffer nullBuffer;
+        std::streambuf * coutBuffer = std::cout.rdbuf(&nullBuffer);
+        for (const size_t options : schemaSizes) {
+            const cmdline::Parser parser(makeOptions(options));
+            measure("help", options, 0, [&] {
+                parser.displayHelp("bench");
+            });
+        }
+        std::cout.rdbuf(coutBuffer);
+    }
+
+    void benchErrors() {
+        for (const size_t options : schemaSizes) {
+            const cmdline::Parser parser(makeOptions(options));
+            std::string bench = "bench", unknown = "--unknown", missing = "--o1";
+            char * unknownArgv[] = { &bench[0], &unknown[0], nullptr };
+            char * missingArgv[] = { &bench[0], &missing[0], nullptr };
+            cmdline::ParseResult result;
+            measureWithoutAllocation("error_unknown_option", options, 2, [&] {
+                parser.tryParse(2, unknownArgv, result);
+                sink = sink + static_cast<size_t>(result.error);
+            });
+            measureWithoutAllocation("error_missing_value", options, 2, [&] {
+                parser.tryParse(2, missingArgv, result);
+                sink = sink + static_cast<size_t>(result.error);
+            });
+        }
+    }
+}
+
+int main() {
+    std::printf("benchmark,options,argc,iterations,ns_per_op,ns_per_arg,allocs_per_op\n");
+    benchSchemaConstruction();
+    benchParse();
+    benchLookup();
+    benchStaticSchema();
+    benchVariadic();
+    benchRepeated();
+    benchEnvironment();
+    benchLayers();
+    benchConfigFile();
+    benchLiveOptions();
+    benchPrescan();
+    benchCommands();
+    benchBatch();
+    benchHelp();
+    benchErrors();
+    return allocationBudgetExceeded ? 1 : 0;
+}
@@ -7,12 +7,59 @@
    - parameter which name start with '-' become optionnal flags
      - supported syntax: "-f=value", "-f value"
      - passing only "-f" is equivalent to passing "-f=true"
+     - long flags can be abbreviated as long as they stay unambiguous: "--verb" for "--verbose"
+     - single character flags can be bundled: "-xvf" is "-x -v -f", and "-ofile" is "-o file"
      - flags "-h, --help, -?" (help) and "-v, --version" (version) can be automatically handled
    - parameter which name don't start with '-' become "positional args":
      - the user can pass them directly on the command line without specifying a flag name
+     - they receive the values in declaration order
      - they are mandatory unless a default value is provided
+     - the last one can take all the remaining values if its name ends with "...", e.g.
+       "inputs...": OptionValues::list("inputs") then returns them all, without copy
      - they can still be associated with a flag name
      - "help" and "version" are reserved names for automatic processing of help and version messages
+   - an option with flags can also be repeated if its name ends with "...", e.g.
+     { { "-I", "include..." }, "Include path" } accepts "-I a -I b", read with list("include")
+   - cmdline::parse() compiles the options on each call: to parse many command lines against
+     the same options, build a cmdline::Parser once and call its parse() method instead
+   - parse() exits the program on errors and help/version requests; Parser::tryParse() reports
+     them in its result (error code + argv index) and lets the caller decide
+   - Parser results are views into argv and into the default values (no copy), looked up by
+     option name or by any of its flags; cmdline::parse() returns a map of std::string copies
+   - an option can declare the type of its value (cmdline::ValueType): it is then checked and
+     converted once while parsing, and read with OptionValues::asInteger(), asBool()...
+   - Parser::visit() streams the command line to a callback (option handle + value) instead of
+     filling a result
+   - response files: cmdline::Arguments::expand() replaces each "@file" argument by the
+     (blank separated, quoted, nested) arguments read from file, and Parser::parse() and
+     tryParse() accept the resulting Arguments instead of argc/argv
+   - Parser::parseBatch() parses many command lines on several threads, into an array of results
+   - parser.parse(argc, argv, cmdline::Environment{ "MYTOOL_" }) (Parser or StaticSchema) also reads
+     the options not given on the command line from MYTOOL_<NAME> environment variables, in one
+     scan of the environment
+   - parser.parse(argc, argv, cmdline::Layers{ &environment, &settings }) resolves each option
+     from the command line, else the environment, else "name = value" settings (cmdline::Settings),
+     else its default value; OptionValues::source() tells which one it came from
+   - cmdline::ConfigFile::load() reads such settings from a file, one "name = value" per line
+   - cmdline::LiveOptions shares option values between threads which read them without locking,
+     while they are replaced (e.g. configuration file reloaded)
+   - cmdline::prescan(argc, argv, { "--config" }) reads a few flags before the options are known
+   - Parser and ParseResult accept a std::pmr::memory_resource (e.g. a monotonic buffer) from
+     which all their memory is allocated
+   - cmdline::Commands handles "tool [global options] command [command options]": each
+     command's options are compiled only when it is selected; Commands::parseMultiCall() also
+     selects the command from the name the program was called with (busybox style)
+   - options known at compile time can be declared as cmdline::StaticOption and compiled by a
+     cmdline::StaticSchema: checks and flag index are then computed by the compiler, e.g.
+
+       static constexpr cmdline::StaticOption options[] = {
+           { "help", "Simple program to rename a file" },
+           { { "-o", "--output", "output" }, "Output file name", "output.txt" }
+       };
+       static constexpr cmdline::StaticSchema<options> schema;
+       static constexpr cmdline::OptionHandle output = schema.option("output"); // checked by the compiler
+       auto args = schema.parse(argc, argv);
+       std::cout << "Writing " << args[output] << std::endl;
 
    Example:
    
@@ -43,21 +90,99 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <iterator>
 #include <iostream>
 #include <cassert>
 #include <initializer_list>
+#include <utility>
+#include <type_traits>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <charconv>
+#include <system_error>
+#include <memory_resource>
+#include <optional>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#ifdef _WIN32
+// keep windows.h from defining min/max macros (and most of its content)
+#ifndef NOMINMAX
+#define NOMINMAX
+#define CMDLINE_PARSER_UNDEF_NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#define CMDLINE_PARSER_UNDEF_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#ifdef CMDLINE_PARSER_UNDEF_NOMINMAX
+#undef NOMINMAX
+#undef CMDLINE_PARSER_UNDEF_NOMINMAX
+#endif
+#ifdef CMDLINE_PARSER_UNDEF_LEAN_AND_MEAN
+#undef WIN32_LEAN_AND_MEAN
+#undef CMDLINE_PARSER_UNDEF_LEAN_AND_MEAN
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern char ** environ; // not declared by all the systems
+#endif
 
 namespace cmdline {
+    namespace priv {
+        // deliberately not constexpr: reaching it while building a StaticSchema stops the compilation
+        inline void schemaError(const char * message) {
+            std::cerr << "Error: invalid program options: " << message << std::endl;
+            assert(false);
+        }
+    }
+
+    // type of the value of an option, checked and converted while parsing
+    struct ValueType {
+        enum Kind : uint8_t {
+            string,
+            integer,          // int64_t
+            unsignedInteger,  // uint64_t
+            floating,         // double
+            boolean,          // true/false, yes/no, on/off, 1/0 (flags without name are booleans)
+            choice            // one of a list of strings, stored as its index in the list
+        };
+
+        Kind kind = string;
+        std::string_view choices; // allowed values separated by '|' for choice
+
+        constexpr ValueType(Kind valueKind = string) : kind(valueKind) {}
+
+        static constexpr ValueType oneOf(std::string_view values) {
+            ValueType type(choice);
+            type.choices = values;
+            return type;
+        }
+    };
+
     struct ProgramOption {
         std::string name;
         std::vector<std::string> flags;
         std::string description;
         std::string defaultValue;
+        ValueType::Kind type = ValueType::string;
+        std::string choices;
 
         ProgramOption() {}
-        ProgramOption(std::string optName, std::string optDescr, std::string optDefVal = "") : name(optName), description(optDescr), defaultValue(optDefVal) {
+        ProgramOption(std::string optName, std::string optDescr, std::string optDefVal = "", ValueType optType = {}) : name(optName), description(optDescr), defaultValue(optDefVal), type(optType.kind), choices(optType.choices) {
             assert(optDescr.back() != '.');
             if (name == "help") {
                 assert(optDefVal.empty());
@@ -75,7 +200,7 @@ namespace cmdline {
                 assert(!description.empty());
             }
         }
-        ProgramOption(std::initializer_list<std::string> optFlags, std::string optDescr, std::string optDefVal = "") : description(optDescr), defaultValue(optDefVal) {
+        ProgramOption(std::initializer_list<std::string> optFlags, std::string optDescr, std::string optDefVal = "", ValueType optType = {}) : description(optDescr), defaultValue(optDefVal), type(optType.kind), choices(optType.choices) {
             assert(optDescr.back() != '.');
             for (const auto & f : optFlags) {
                 if (f.front() == '-') {
@@ -89,13 +214,109 @@ namespace cmdline {
         }
     };
 
+    // same as ProgramOption but usable in constant expressions, to declare a StaticSchema
+    struct StaticOption {
+        // replaces the std::vector of ProgramOption::flags
+        class FlagList {
+        public:
+            constexpr size_t size() const { return count; }
+            constexpr std::string_view operator[](size_t i) const { return items[i]; }
+            constexpr void push_back(std::string_view flag) {
+                if (count == capacity) {
+                    priv::schemaError("too many flags for a single option");
+                    return;
+                }
+                items[count++] = flag;
+            }
+
+        private:
+            static constexpr size_t capacity = 8;
+            std::string_view items[capacity] = {};
+            size_t count = 0;
+        };
+
+        std::string_view name;
+        FlagList flags;
+        std::string_view description;
+        std::string_view defaultValue;
+        ValueType::Kind type = ValueType::string;
+        std::string_view choices;
+
+        constexpr StaticOption(std::string_view optName, std::string_view optDescr, std::string_view optDefVal = {}, ValueType optType = {}) : name(optName), description(optDescr), defaultValue(optDefVal), type(optType.kind), choices(optType.choices) {
+            if (optDescr.empty() || optDescr.back() == '.') {
+                priv::schemaError("descriptions must neither be empty nor end with '.'");
+            }
+            if (name == "help" || name == "version") {
+                if (!optDefVal.empty()) {
+                    priv::schemaError("'help' and 'version' have no default value");
+                }
+                description = (name == "help") ? "print this help message" : "print program version";
+                defaultValue = optDescr;
+                flags.push_back((name == "help") ? "-h" : "-v");
+                flags.push_back((name == "help") ? "--help" : "--version");
+            }
+        }
+        constexpr StaticOption(std::initializer_list<std::string_view> optFlags, std::string_view optDescr, std::string_view optDefVal = {}, ValueType optType = {}) : description(optDescr), defaultValue(optDefVal), type(optType.kind), choices(optType.choices) {
+            if (optDescr.empty() || optDescr.back() == '.') {
+                priv::schemaError("descriptions must neither be empty nor end with '.'");
+            }
+            for (const auto f : optFlags) {
+                if (!f.empty() && f.front() == '-') {
+                    flags.push_back(f);
+                }
+                else if (name.empty()) {
+                    name = f;
+                }
+                else {
+                    priv::schemaError("an option can have only one name");
+                }
+            }
+        }
+    };
+
+    // reasons for which a command line could not be turned into option values
+    enum class ParseError {
+        none,
+        unknownOption,      // argument starting with '-' that matches no flag
+        missingValue,       // named option given as last argument or followed by another flag
+        unexpectedValue,    // positional argument that no option can receive
+        missingPositional,  // mandatory positional argument not given
+        helpRequested,      // "-h" or "--help" was given
+        versionRequested,   // "-v" or "--version" was given
+        invalidValue,       // value not matching the type of its option (number, boolean, choice)
+        outOfRange,         // number too large for the type of its option
+        unreadableResponseFile, // "@file" argument naming a file which cannot be read
+        responseFileCycle,      // response file including itself, directly or not
+        ambiguousOption,    // "--verb" abbreviating several options (--verbose, --verbosity)
+        missingCommand,     // no command given to a program having subcommands (Commands)
+        unknownCommand,     // command name not declared
+        unreadableConfigFile, // configuration file which cannot be read (ConfigFile)
+        invalidSetting,     // line of a configuration file which is not "name = value"
+        duplicateOption     // option taking a single value given twice ("-x -x", "-xx")
+    };
+
+    // where the value of an option comes from, by increasing priority
+    enum class ValueSource : uint8_t {
+        defaultValue,   // not given
+        configFile,     // see Settings
+        environment,    // see Environment
+        commandLine
+    };
+
     std::map<std::string, std::string>
     parse(int argc, char *argv[], std::vector<ProgramOption> options);
-    
+
+    struct ParseResult;
+    struct ParseStatus;
+    class OptionValues;
+    struct Environment;
+    class Settings;
+    struct Layers;
+
     namespace priv {
-        inline std::string extractProgramName(const std::string & argv0) {
+        inline std::string_view baseName(std::string_view argv0) {
             size_t lastSlash = argv0.find_last_of('/');
-            if (lastSlash == std::string::npos) {
+            if (lastSlash == std::string_view::npos) {
                 lastSlash = 0;
             }
             else {
@@ -110,23 +331,661 @@ namespace cmdline {
             return argv0.substr(lastSlash);
         }
 
-        inline void displayHelpMessageWindowsStyle(const std::string & argv0, const std::vector<ProgramOption> & options) {
-            std::string aboutMsg;
+        inline std::string extractProgramName(const std::string & argv0) {
+            return std::string(baseName(argv0));
+        }
+
+        // name of a multi-call program, as called (through a link to it)
+        inline std::string_view calledName(std::string_view argv0) {
+            std::string_view name = baseName(argv0);
+#ifdef _WIN32
+            if (name.size() > 4 && (name.substr(name.size() - 4) == ".exe" || name.substr(name.size() - 4) == ".EXE")) {
+                name.remove_suffix(4);
+            }
+#endif
+            return name;
+        }
+
+        // role of an option while scanning argv, computed once when compiling the options
+        enum class OptionKind : uint8_t {
+            flag,        // only flags: set to "true" when given
+            value,       // name + flags: the flag is followed by a value
+            positional,  // only a name: receives a value given without flag
+            help,
+            version
+        };
+
+        constexpr OptionKind optionKind(std::string_view name, size_t flagCount) {
+            if (name == "help") {
+                return OptionKind::help;
+            }
+            else if (name == "version") {
+                return OptionKind::version;
+            }
+            else if (name.empty()) {
+                return OptionKind::flag;
+            }
+            return (flagCount == 0) ? OptionKind::positional : OptionKind::value;
+        }
+
+        // converted value of an option which type is not ValueType::string
+        struct TypedValue {
+            int64_t integer = 0;           // also booleans (0 or 1) and choices (index)
+            uint64_t unsignedInteger = 0;
+            double floating = 0;
+        };
+
+        constexpr bool parseBoolean(std::string_view text, TypedValue & value) {
+            if (text == "true" || text == "yes" || text == "on" || text == "1") {
+                value.integer = 1;
+                return true;
+            }
+            if (text == "false" || text == "no" || text == "off" || text == "0") {
+                value.integer = 0;
+                return true;
+            }
+            return false;
+        }
+
+        constexpr bool parseChoice(std::string_view text, std::string_view choices, TypedValue & value) {
+            int64_t index = 0;
+            for (size_t begin = 0; begin <= choices.size(); ++index) {
+                size_t end = choices.find('|', begin);
+                end = (end == std::string_view::npos) ? choices.size() : end;
+                if (choices.substr(begin, end - begin) == text) {
+                    value.integer = index;
+                    return true;
+                }
+                begin = end + 1;
+            }
+            return false;
+        }
+
+        // conversion of command line values: std::from_chars, so locale independent
+        inline ParseError convertValue(ValueType::Kind type, std::string_view choices, std::string_view text, TypedValue & value) {
+            const char * first = text.data();
+            const char * last = text.data() + text.size();
+            std::from_chars_result result{ first, std::errc::invalid_argument };
+            switch (type) {
+            case ValueType::string:
+                return ParseError::none;
+            case ValueType::integer:
+                result = std::from_chars(first, last, value.integer);
+                break;
+            case ValueType::unsignedInteger:
+                result = std::from_chars(first, last, value.unsignedInteger);
+                break;
+            case ValueType::floating:
+                result = std::from_chars(first, last, value.floating);
+                break;
+            case ValueType::boolean:
+                return parseBoolean(text, value) ? ParseError::none : ParseError::invalidValue;
+            case ValueType::choice:
+                return parseChoice(text, choices, value) ? ParseError::none : ParseError::invalidValue;
+            }
+            if (result.ec == std::errc::result_out_of_range) {
+                return ParseError::outOfRange;
+            }
+            return (result.ec == std::errc() && result.ptr == last) ? ParseError::none : ParseError::invalidValue;
+        }
+
+        // conversion of StaticSchema default values, usable in constant expressions: floating point
+        // values are limited to what double arithmetic converts exactly (15 digits, exponent within
+        // +/-22); Parser converts its defaults with convertValue()
+        constexpr bool convertDefault(ValueType::Kind type, std::string_view choices, std::string_view text, TypedValue & value) {
+            if (type == ValueType::boolean) {
+                return text.empty() || parseBoolean(text, value);
+            }
+            if (type == ValueType::choice && text.empty()) {
+                value.integer = -1;
+                return true;
+            }
+            if (type == ValueType::choice) {
+                return parseChoice(text, choices, value);
+            }
+            if (type == ValueType::string || text.empty()) {
+                return true;
+            }
+            size_t i = 0;
+            const bool negative = (text[0] == '-');
+            i += negative ? 1 : 0;
+            uint64_t digits = 0;
+            int digitCount = 0;
+            int exponent = 0;
+            bool afterPoint = false;
+            bool hasDigit = false;
+            for (; i < text.size(); ++i) {
+                const char c = text[i];
+                if (c == '.' && type == ValueType::floating && !afterPoint) {
+                    afterPoint = true;
+                }
+                else if (c >= '0' && c <= '9') {
+                    const uint64_t digit = static_cast<uint64_t>(c - '0');
+                    if (digits > (UINT64_MAX - digit) / 10) {
+                        return false;
+                    }
+                    digits = digits * 10 + digit;
+                    digitCount += (digits != 0) ? 1 : 0;
+                    hasDigit = true;
+                    exponent -= afterPoint ? 1 : 0;
+                }
+                else if ((c == 'e' || c == 'E') && type == ValueType::floating && hasDigit && i + 1 < text.size()) {
+                    const bool negativeExponent = (text[i + 1] == '-');
+                    int value10 = 0;
+                    i += (text[i + 1] == '-' || text[i + 1] == '+') ? 2 : 1;
+                    if (i == text.size()) {
+                        return false;
+                    }
+                    for (; i < text.size(); ++i) {
+                        if (text[i] < '0' || text[i] > '9') {
+                            return false;
+                        }
+                        value10 = (value10 < 1000) ? value10 * 10 + (text[i] - '0') : value10;
+                    }
+                    exponent += negativeExponent ? -value10 : value10;
+                    break;
+                }
+                else {
+                    return false;
+                }
+            }
+            if (!hasDigit) {
+                return false;
+            }
+            switch (type) {
+            case ValueType::integer:
+                if (digits > static_cast<uint64_t>(INT64_MAX) + (negative ? 1 : 0)) {
+                    return false;
+                }
+                value.integer = negative ? static_cast<int64_t>(0 - digits) : static_cast<int64_t>(digits);
+                return true;
+            case ValueType::unsignedInteger:
+                value.unsignedInteger = digits;
+                return !negative;
+            case ValueType::floating: {
+                if (digitCount > 15 || exponent < -22 || exponent > 22) {
+                    return false;
+                }
+                double power = 1;
+                for (int e = 0; e < (exponent < 0 ? -exponent : exponent); ++e) {
+                    power *= 10;
+                }
+                const double result = (exponent < 0) ? static_cast<double>(digits) / power : static_cast<double>(digits) * power;
+                value.floating = negative ? -result : result;
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+
+        // location of a string in the character buffer of a schema
+        struct StringRef {
+            uint32_t offset = 0;
+            uint32_t length = 0;
+        };
+
+        // an option once compiled: its strings live in the character buffer of the schema
+        struct OptionEntry {
+            StringRef name;
+            StringRef description;
+            StringRef defaultValue;
+            uint32_t firstFlag = 0; // its flags are keys[firstFlag .. firstFlag + flagCount]
+            uint32_t flagCount = 0;
+            OptionKind kind = OptionKind::flag;
+            ValueType::Kind type = ValueType::string;
+            StringRef choices;
+            TypedValue defaultTyped;
+            bool repeated = false;  // name declared with a "..." suffix: receives several values
+        };
+
+        constexpr uint32_t npos = static_cast<uint32_t>(-1);
+        constexpr uint32_t ambiguous = npos - 1; // prefix of the flags of several options
+
+        // node of the trie of long flags ("--..."), stored without their leading "--"
+        struct TrieNode {
+            uint32_t firstChild = npos;
+            uint32_t nextSibling = npos;
+            uint32_t option = npos;  // option of all the flags below this node, or ambiguous
+            uint32_t key = npos;     // flag ending at this node
+            char c = 0;
+        };
+
+        // FNV-1a, used to index option names and flags
+        constexpr uint64_t hashKey(std::string_view key) {
+            uint64_t hash = 14695981039346656037ull;
+            for (const char c : key) {
+                hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        // the low bits of the hash select a bucket of keys, and the displacement of the bucket is
+        // chosen when building the table so that its keys land in free slots ("hash and displace")
+        constexpr uint32_t keySlot(uint64_t hash, uint32_t displacement) {
+            uint64_t x = hash ^ (static_cast<uint64_t>(displacement) * 0x9E3779B97F4A7C15ull);
+            x ^= x >> 33;
+            x *= 0xFF51AFD7ED558CCDull;
+            x ^= x >> 33;
+            return static_cast<uint32_t>(x);
+        }
+
+        // read-only view over the tables of a Parser or of a StaticSchema
+        struct SchemaView {
+            const char * chars = nullptr;
+            const OptionEntry * options = nullptr;
+            uint32_t optionCount = 0;
+            const StringRef * keys = nullptr;       // flags then name of each option, in order
+            const uint32_t * keyOptions = nullptr;  // key i belongs to options[keyOptions[i]]
+            const uint32_t * keyTable = nullptr;    // 1 + key index, 0 for an empty slot
+            uint32_t keyTableMask = 0;
+            const uint32_t * displacements = nullptr;
+            uint32_t bucketMask = 0;
+            uint32_t positionalIndex = npos;        // first positional option
+            const uint32_t * shortFlags = nullptr;  // 256 entries: option of "-c" for each c, or npos
+            const TrieNode * trie = nullptr;        // root first
+
+            constexpr std::string_view str(StringRef ref) const {
+                return std::string_view(chars + ref.offset, ref.length);
+            }
+
+            constexpr std::string_view flag(const OptionEntry & opt, uint32_t i) const {
+                return str(keys[opt.firstFlag + i]);
+            }
+
+            // index of the option having this name or flag, npos if none
+            constexpr uint32_t findKey(std::string_view key) const {
+                return findKey(key, hashKey(key));
+            }
+
+            // same, hash being hashKey(key)
+            constexpr uint32_t findKey(std::string_view key, uint64_t hash) const {
+                const uint32_t entry = keyTable[keySlot(hash, displacements[hash & bucketMask]) & keyTableMask];
+                if (entry != 0 && str(keys[entry - 1]) == key) {
+                    return keyOptions[entry - 1];
+                }
+                return npos;
+            }
+
+            // trie node reached by a long flag or a prefix of it, npos if none
+            constexpr uint32_t findTrieNode(std::string_view flag) const {
+                if (flag.size() < 2 || flag[0] != '-' || flag[1] != '-') {
+                    return npos;
+                }
+                uint32_t node = 0;
+                for (size_t i = 2; i < flag.size() && node != npos; ++i) {
+                    node = trie[node].firstChild;
+                    while (node != npos && trie[node].c != flag[i]) {
+                        node = trie[node].nextSibling;
+                    }
+                }
+                return node;
+            }
+
+            // option of the long flags starting with prefix: npos if none, ambiguous if several
+            constexpr uint32_t findPrefix(std::string_view prefix) const {
+                const uint32_t node = findTrieNode(prefix);
+                return (node != npos) ? trie[node].option : npos;
+            }
+
+            // positional option declared after options[index], npos if none
+            constexpr uint32_t nextPositional(uint32_t index) const {
+                for (uint32_t i = index + 1; i < optionCount; ++i) {
+                    if (options[i].kind == OptionKind::positional) {
+                        return i;
+                    }
+                }
+                return npos;
+            }
+        };
+
+        // sizes of the tables needed to compile a list of ProgramOption or StaticOption
+        template <class Option>
+        constexpr uint32_t countKeys(const Option * options, size_t optionCount) {
+            size_t count = 0;
+            for (size_t i = 0; i < optionCount; ++i) {
+                count += options[i].flags.size() + (options[i].name.empty() ? 0 : 1);
+            }
+            return static_cast<uint32_t>(count);
+        }
+
+        template <class Option>
+        constexpr uint32_t countChars(const Option * options, size_t optionCount) {
+            size_t count = 0;
+            for (size_t i = 0; i < optionCount; ++i) {
+                const auto & opt = options[i];
+                count += opt.name.size() + opt.description.size() + opt.defaultValue.size() + opt.choices.size();
+                for (size_t j = 0; j < opt.flags.size(); ++j) {
+                    count += opt.flags[j].size();
+                }
+            }
+            return static_cast<uint32_t>(count);
+        }
+
+        // upper bound of the number of nodes of the trie of long flags
+        template <class Option>
+        constexpr uint32_t countTrieNodes(const Option * options, size_t optionCount) {
+            size_t count = 1;
+            for (size_t i = 0; i < optionCount; ++i) {
+                for (size_t j = 0; j < options[i].flags.size(); ++j) {
+                    const std::string_view flag = options[i].flags[j];
+                    count += (flag.size() > 2 && flag[1] == '-') ? flag.size() - 2 : 0;
+                }
+            }
+            return static_cast<uint32_t>(count);
+        }
+
+        // at most one key out of two slots keeps the displacement search short
+        constexpr uint32_t keyTableSize(uint32_t keyCount) {
+            uint32_t size = 1;
+            while (size < 2 * keyCount) {
+                size *= 2;
+            }
+            return size;
+        }
+
+        constexpr uint32_t bucketCount(uint32_t keyCount) {
+            uint32_t count = 1;
+            while (2 * count < keyCount) {
+                count *= 2;
+            }
+            return count;
+        }
+
+        constexpr bool isValidFlag(std::string_view flag) {
+            if (flag.size() < 2 || flag.front() != '-' || flag == "--") {
+                return false;
+            }
+            for (const char c : flag) {
+                if (c == '=' || c == ' ' || c == '\t') {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        constexpr StringRef storeString(char * chars, uint32_t & size, std::string_view str) {
+            const StringRef ref{ size, static_cast<uint32_t>(str.size()) };
+            for (const char c : str) {
+                chars[size++] = c;
+            }
+            return ref;
+        }
+
+        // copy the options into tables sized by countKeys() and countChars(), return the index of
+        // the first positional option
+        template <class Option>
+        constexpr uint32_t storeOptions(const Option * options, uint32_t optionCount, char * chars, OptionEntry * entries, StringRef * keys, uint32_t * keyOptions) {
+            uint32_t charCount = 0;
+            uint32_t keyCount = 0;
+            uint32_t positional = npos;
+            bool variadic = false;
+            for (uint32_t i = 0; i < optionCount; ++i) {
+                const auto & opt = options[i];
+                std::string_view name = opt.name;
+                auto & entry = entries[i];
+                entry.repeated = (name.size() > 3 && name.substr(name.size() - 3) == "...");
+                name = entry.repeated ? name.substr(0, name.size() - 3) : name;
+                entry.kind = optionKind(name, opt.flags.size());
+                entry.name = storeString(chars, charCount, name);
+                entry.description = storeString(chars, charCount, opt.description);
+                entry.defaultValue = storeString(chars, charCount, opt.defaultValue);
+                entry.firstFlag = keyCount;
+                entry.flagCount = static_cast<uint32_t>(opt.flags.size());
+                entry.type = (entry.kind == OptionKind::flag) ? ValueType::boolean : opt.type;
+                entry.type = (entry.kind == OptionKind::help || entry.kind == OptionKind::version) ? ValueType::string : entry.type;
+                entry.choices = storeString(chars, charCount, opt.choices);
+                if (entry.type == ValueType::choice && opt.choices.empty()) {
+                    schemaError("choice options need a list of allowed values");
+                }
+                // Parser converts its defaults like command line values, StaticSchema at compile time
+                bool converted = false;
+                if constexpr (std::is_same_v<Option, ProgramOption>) {
+                    converted = opt.defaultValue.empty() || entry.type == ValueType::boolean || entry.type == ValueType::choice
+                        ? convertDefault(entry.type, opt.choices, opt.defaultValue, entry.defaultTyped)
+                        : convertValue(entry.type, opt.choices, opt.defaultValue, entry.defaultTyped) == ParseError::none;
+                }
+                else {
+                    converted = convertDefault(entry.type, opt.choices, opt.defaultValue, entry.defaultTyped);
+                }
+                if (!converted) {
+                    schemaError("default value not matching the type of its option");
+                }
+                for (size_t j = 0; j < opt.flags.size(); ++j) {
+                    const std::string_view flag = opt.flags[j];
+                    if (!isValidFlag(flag)) {
+                        schemaError("flags start with '-' and contain neither '=' nor spaces");
+                    }
+                    keyOptions[keyCount] = i;
+                    keys[keyCount++] = storeString(chars, charCount, flag);
+                }
+                if (!name.empty()) {
+                    if (name.front() == '-') {
+                        schemaError("option names must not start with '-'");
+                    }
+                    keyOptions[keyCount] = i;
+                    keys[keyCount++] = entry.name;
+                }
+                if (entry.repeated && entry.kind != OptionKind::positional && entry.kind != OptionKind::value) {
+                    schemaError("only options taking a value can take several values");
+                }
+                if (entry.kind == OptionKind::positional) {
+                    if (variadic) {
+                        schemaError("a positional option taking several values must be the last one");
+                    }
+                    variadic = entry.repeated;
+                    positional = (positional == npos) ? i : positional;
+                }
+            }
+            return positional;
+        }
+
+        // fill shortFlags (256 entries) with the option of each single character flag "-c"
+        constexpr void buildShortFlags(const char * chars, const OptionEntry * entries, uint32_t optionCount, const StringRef * keys, uint32_t * shortFlags) {
+            for (uint32_t c = 0; c < 256; ++c) {
+                shortFlags[c] = npos;
+            }
+            for (uint32_t i = 0; i < optionCount; ++i) {
+                for (uint32_t f = entries[i].firstFlag; f < entries[i].firstFlag + entries[i].flagCount; ++f) {
+                    const char c = chars[keys[f].offset + 1];
+                    if (keys[f].length == 2 && c != '-') {
+                        shortFlags[static_cast<uint8_t>(c)] = i;
+                    }
+                }
+            }
+        }
+
+        // fill trie (countTrieNodes() entries) with the long flags, return the number of nodes used;
+        // siblings are scanned linearly, which is cheap as flags share few characters per position
+        constexpr uint32_t buildPrefixTrie(const char * chars, const OptionEntry * entries, uint32_t optionCount, const StringRef * keys, TrieNode * trie) {
+            uint32_t nodeCount = 1;
+            trie[0] = TrieNode{};
+            for (uint32_t i = 0; i < optionCount; ++i) {
+                for (uint32_t f = entries[i].firstFlag; f < entries[i].firstFlag + entries[i].flagCount; ++f) {
+                    const std::string_view flag(chars + keys[f].offset, keys[f].length);
+                    if (flag.size() < 3 || flag[1] != '-') {
+                        continue;
+                    }
+                    uint32_t node = 0;
+                    for (size_t c = 2; c < flag.size(); ++c) {
+                        uint32_t child = trie[node].firstChild;
+                        while (child != npos && trie[child].c != flag[c]) {
+                            child = trie[child].nextSibling;
+                        }
+                        if (child == npos) {
+                            child = nodeCount++;
+                            trie[child] = TrieNode{};
+                            trie[child].c = flag[c];
+                            trie[child].nextSibling = trie[node].firstChild;
+                            trie[node].firstChild = child;
+                        }
+                        node = child;
+                        trie[node].option = (trie[node].option == npos || trie[node].option == i) ? i : ambiguous;
+                    }
+                    trie[node].key = f;
+                }
+            }
+            return nodeCount;
+        }
+
+        // flags of the trie below node
+        inline void collectTrieFlags(const SchemaView & schema, uint32_t node, std::vector<std::string_view> & flags) {
+            if (schema.trie[node].key != npos) {
+                flags.push_back(schema.str(schema.keys[schema.trie[node].key]));
+            }
+            for (uint32_t child = schema.trie[node].firstChild; child != npos; child = schema.trie[child].nextSibling) {
+                collectTrieFlags(schema, child, flags);
+            }
+        }
+
+        // long flags starting with prefix, sorted
+        inline std::vector<std::string_view> prefixCandidates(const SchemaView & schema, std::string_view prefix) {
+            std::vector<std::string_view> flags;
+            const uint32_t node = schema.findTrieNode(prefix);
+            if (node != npos) {
+                collectTrieFlags(schema, node, flags);
+            }
+            std::sort(flags.begin(), flags.end());
+            return flags;
+        }
+
+        // fill keyTable (keyTableSize() slots) and displacements (bucketCount() entries);
+        // bucketStarts (bucketCount() + 1 entries) and bucketKeys (keyCount entries) are scratch
+        constexpr void buildKeyTable(const char * chars, const StringRef * keys, uint32_t keyCount, uint32_t * keyTable, uint32_t tableSize,
+                                     uint32_t * displacements, uint32_t bucketCount, uint32_t * bucketStarts, uint32_t * bucketKeys) {
+            const auto keyAt = [chars, keys](uint32_t key) {
+                return std::string_view(chars + keys[key].offset, keys[key].length);
+            };
+
+            // group keys by bucket
+            for (uint32_t b = 0; b <= bucketCount; ++b) {
+                bucketStarts[b] = 0;
+            }
+            for (uint32_t k = 0; k < keyCount; ++k) {
+                ++bucketStarts[(hashKey(keyAt(k)) & (bucketCount - 1)) + 1];
+            }
+            uint32_t largestBucket = 0;
+            for (uint32_t b = 0; b < bucketCount; ++b) {
+                largestBucket = (bucketStarts[b + 1] > largestBucket) ? bucketStarts[b + 1] : largestBucket;
+                bucketStarts[b + 1] += bucketStarts[b];
+            }
+            for (uint32_t k = 0; k < keyCount; ++k) {
+                bucketKeys[bucketStarts[hashKey(keyAt(k)) & (bucketCount - 1)]++] = k;
+            }
+            for (uint32_t b = bucketCount; b > 0; --b) {
+                bucketStarts[b] = bucketStarts[b - 1];
+            }
+            bucketStarts[0] = 0;
+
+            // place the largest buckets first, while the table is still mostly empty
+            for (uint32_t t = 0; t < tableSize; ++t) {
+                keyTable[t] = 0;
+            }
+            for (uint32_t size = largestBucket; size > 0; --size) {
+                for (uint32_t b = 0; b < bucketCount; ++b) {
+                    const uint32_t first = bucketStarts[b];
+                    displacements[b] = (size == largestBucket) ? 0 : displacements[b];
+                    if (bucketStarts[b + 1] - first != size) {
+                        continue;
+                    }
+                    // identical keys always share a bucket
+                    for (uint32_t i = first; i < first + size; ++i) {
+                        for (uint32_t j = i + 1; j < first + size; ++j) {
+                            if (keyAt(bucketKeys[i]) == keyAt(bucketKeys[j])) {
+                                schemaError("option names and flags must be unique");
+                                return;
+                            }
+                        }
+                    }
+                    for (uint32_t d = 0;; ++d) {
+                        if (d == (1u << 20)) {
+                            schemaError("failed to build the flag index");
+                            return;
+                        }
+                        bool isFree = true;
+                        for (uint32_t i = first; isFree && i < first + size; ++i) {
+                            const uint32_t slot = keySlot(hashKey(keyAt(bucketKeys[i])), d) & (tableSize - 1);
+                            isFree = (keyTable[slot] == 0);
+                            for (uint32_t j = first; isFree && j < i; ++j) {
+                                isFree = (slot != (keySlot(hashKey(keyAt(bucketKeys[j])), d) & (tableSize - 1)));
+                            }
+                        }
+                        if (isFree) {
+                            for (uint32_t i = first; i < first + size; ++i) {
+                                keyTable[keySlot(hashKey(keyAt(bucketKeys[i])), d) & (tableSize - 1)] = bucketKeys[i] + 1;
+                            }
+                            displacements[b] = d;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        // perfect hash index of a list of names (e.g. subcommands), built like the flag index
+        class NameIndex {
+        public:
+            NameIndex(const std::vector<std::string_view> & names, std::pmr::memory_resource * resource)
+                : chars(resource), keys(resource), keyTable(resource), displacements(resource) {
+                size_t charCount = 0;
+                for (const std::string_view name : names) {
+                    charCount += name.size();
+                }
+                chars.resize(charCount);
+                keys.resize(names.size());
+                uint32_t size = 0;
+                for (size_t i = 0; i < names.size(); ++i) {
+                    keys[i] = storeString(chars.data(), size, names[i]);
+                }
+                const uint32_t keyCount = static_cast<uint32_t>(keys.size());
+                keyTable.resize(keyTableSize(keyCount));
+                displacements.resize(bucketCount(keyCount));
+                std::pmr::vector<uint32_t> bucketStarts(displacements.size() + 1, resource);
+                std::pmr::vector<uint32_t> bucketKeys(keyCount, resource);
+                buildKeyTable(chars.data(), keys.data(), keyCount, keyTable.data(), static_cast<uint32_t>(keyTable.size()),
+                              displacements.data(), static_cast<uint32_t>(displacements.size()), bucketStarts.data(), bucketKeys.data());
+            }
+
+            // index of name in the list, npos if absent
+            uint32_t find(std::string_view name) const {
+                const uint64_t hash = hashKey(name);
+                const uint32_t slot = keySlot(hash, displacements[hash & (displacements.size() - 1)]) & static_cast<uint32_t>(keyTable.size() - 1);
+                const uint32_t entry = keyTable[slot];
+                if (entry != 0 && std::string_view(chars.data() + keys[entry - 1].offset, keys[entry - 1].length) == name) {
+                    return entry - 1;
+                }
+                return npos;
+            }
+
+        private:
+            std::pmr::vector<char> chars;
+            std::pmr::vector<StringRef> keys;
+            std::pmr::vector<uint32_t> keyTable;
+            std::pmr::vector<uint32_t> displacements;
+        };
+
+        inline void displayHelpMessageWindowsStyle(const std::string & argv0, const SchemaView & schema) {
+            std::string_view aboutMsg;
             std::string allFlags;
             std::string allPositionals;
-            for (const auto & opt : options) {
-                if (opt.name == "help") {
-                    aboutMsg = opt.defaultValue;
+            for (uint32_t i = 0; i < schema.optionCount; ++i) {
+                const auto & opt = schema.options[i];
+                if (opt.kind == OptionKind::help) {
+                    aboutMsg = schema.str(opt.defaultValue);
                 }
-                else if (opt.name == "version") {
+                else if (opt.kind == OptionKind::version) {
                     // ignore
                 }
-                else if (opt.name.empty()) {
-                    assert(!opt.flags.empty());
-                    allFlags += " [" + opt.flags.front() + "]";
+                else if (opt.kind == OptionKind::flag) {
+                    assert(opt.flagCount != 0);
+                    allFlags += " [";
+                    allFlags += schema.flag(opt, 0);
+                    allFlags += "]";
                 }
                 else {
-                    allPositionals += " " + opt.name;
+                    allPositionals += " ";
+                    allPositionals += schema.str(opt.name);
+                    allPositionals += opt.repeated ? "..." : "";
                 }
             }
 
@@ -138,52 +997,50 @@ namespace cmdline {
             std::cout << extractProgramName(argv0) << allFlags << allPositionals << "\n";
 
             std::cout << "\n";
-            for (const auto opt : options) {
-                if (!opt.flags.empty()) {
+            for (uint32_t i = 0; i < schema.optionCount; ++i) {
+                const auto & opt = schema.options[i];
+                if (opt.flagCount != 0) {
                     std::string allFlags;
-                    for (const auto & f : opt.flags) {
+                    for (uint32_t f = 0; f < opt.flagCount; ++f) {
                         if (!allFlags.empty()) {
                             allFlags += ", ";
                         }
-                        allFlags += f;
+                        allFlags += schema.flag(opt, f);
                     }
                     std::cout << "  " << allFlags << "\n";
-                    std::cout << std::string(8, ' ') << opt.description << "\n";
+                    std::cout << std::string(8, ' ') << schema.str(opt.description) << "\n";
                 }
             }
             std::cout << std::endl;
         }
 
-        inline void displayHelpMessage(const std::string & argv0, const std::vector<ProgramOption> & options) {
-            std::string aboutMsg;
-            std::string allFlags;
+        // extraUsage is appended to the usage line, e.g. to mention a subcommand
+        inline void displayHelpMessage(const std::string & argv0, const SchemaView & schema, std::string_view extraUsage = {}) {
+            std::string_view aboutMsg;
             std::string allPositionals;
             std::string helpAndVersion;
-            for (const auto & opt : options) {
-                if (opt.name == "help") {
-                    aboutMsg = opt.defaultValue;
-                    for (auto f : opt.flags) {
-                        if (!helpAndVersion.empty()) {
-                            helpAndVersion += " | ";
-                        }
-                        helpAndVersion += f;
+            for (uint32_t i = 0; i < schema.optionCount; ++i) {
+                const auto & opt = schema.options[i];
+                if (opt.kind == OptionKind::help || opt.kind == OptionKind::version) {
+                    if (opt.kind == OptionKind::help) {
+                        aboutMsg = schema.str(opt.defaultValue);
                     }
-                }
-                else if (opt.name == "version") {
-                    for (auto f : opt.flags) {
+                    for (uint32_t f = 0; f < opt.flagCount; ++f) {
                         if (!helpAndVersion.empty()) {
                             helpAndVersion += " | ";
                         }
-                        helpAndVersion += f;
+                        helpAndVersion += schema.flag(opt, f);
                     }
                 }
-                else if (!opt.name.empty()) {
-                    allPositionals += " " + opt.name;
+                else if (opt.kind != OptionKind::flag) {
+                    allPositionals += " ";
+                    allPositionals += schema.str(opt.name);
+                    allPositionals += opt.repeated ? "..." : "";
                 }
             }
 
             const std::string progName = extractProgramName(argv0);
-            std::cout << "Usage: " << progName << " [OPTIONS]" << allPositionals << "\n";
+            std::cout << "Usage: " << progName << " [OPTIONS]" << allPositionals << extraUsage << "\n";
             if (!helpAndVersion.empty()) {
                 std::cout << "       " << progName << " [" << helpAndVersion << "]\n";
             }
@@ -197,105 +1054,1810 @@ namespace cmdline {
             std::cout << "Options:\n";
             std::cout << "\n";
 
-            for (const auto opt : options) {
-                if (!opt.flags.empty()) {
+            for (uint32_t i = 0; i < schema.optionCount; ++i) {
+                const auto & opt = schema.options[i];
+                if (opt.flagCount != 0) {
                     std::string allFlags;
-                    for (const auto & f : opt.flags) {
+                    for (uint32_t f = 0; f < opt.flagCount; ++f) {
                         if (!allFlags.empty()) {
                             allFlags += ", ";
                         }
-                        allFlags += f;
+                        allFlags += schema.flag(opt, f);
                     }
                     size_t paddingLength = (allFlags.length() < 20) ? (20 - allFlags.length()) : 0;
-                    std::cout << "  " << allFlags << std::string(paddingLength, ' ') << opt.description << "\n";
+                    std::cout << "  " << allFlags << std::string(paddingLength, ' ') << schema.str(opt.description) << "\n";
                 }
             }
             std::cout << std::endl;
         }
 
-        inline void setValue(std::map<std::string, std::string> & result, const ProgramOption & opt, const std::string & value) {
-            assert(result[opt.name].empty());
-            result[opt.name] = value;
-        }
-    }
+        // values of an option taking several values, in OptionValues::lists
+        struct ListRef {
+            uint32_t first = 0;
+            uint32_t count = 0;
+        };
 
-    inline std::map<std::string, std::string>
-    parse(int argc, char *argv[], std::vector<ProgramOption> options) {
-        std::map<std::string, std::string> result;
-        ProgramOption positionalOption{};
-        
-        // associate each flag with its full description + fill default values
-        std::map<std::string, ProgramOption> allFlags;
-        for (const auto opt : options) {
-            for (auto name : opt.flags) {
-                assert(allFlags.count(name) == 0);
-                allFlags[name] = opt;
-                result[name] = opt.defaultValue;
-            }
-            if (!opt.name.empty() && opt.flags.empty() && opt.name != "help" && opt.name != "version") {
-                assert(positionalOption.name.empty()); // only 1 positional option
-                positionalOption = opt;
-            }
-        }
-
-        // process the given command line
-        for (int i = 1; i < argc; ++i) {
-            const std::string arg = argv[i];
-            if (arg.front() == '-') {
-                const auto it = allFlags.find(arg);
-                if (it != allFlags.end()) {
-                    const auto opt = it->second;
-                    // process reserved names
-                    if (opt.name == "help") {
-                        priv::displayHelpMessage(argv[0], options);
-                        std::cout.flush();
-                        std::exit(0);
-                    }
-                    else if (opt.name == "version") {
-                        std::cout << opt.defaultValue << std::endl;
-                        std::exit(0);
-                    }
-                    // process named options
-                    else if (!opt.name.empty()) {
-                        // we expect a value for named options
-                        ++i;
-                        if (i == argc || argv[i][0] == '-') {
-                            std::cerr << "Error: missing value for option '" << arg << "' (" << opt.description << ").\n";
-                            std::exit(1);
-                        }
-                        priv::setValue(result, opt, argv[i]);
-                    }
-                    // process flags
-                    else {
-                        priv::setValue(result, opt, "true");
-                    }
-                }
-                else {
-                    std::cerr << "Error: unknown option '" << arg << "'" << std::endl;
-                    priv::displayHelpMessage(argv[0], options);
-                    std::exit(1);
-                }
-            }
-            else if (!positionalOption.name.empty()) {
-                priv::setValue(result, positionalOption, arg);
-                // for now, we support only 1 positional arg value
-                positionalOption = ProgramOption{};
-            }
-            else {
-                std::cerr << "Error: unexpected value '" << arg << "'." << std::endl;
-                priv::displayHelpMessage(argv[0], options);
-                std::exit(1);
+        // a value can be given only once on the command line
+        inline ParseError setValue(std::string_view & slot, ValueSource & source, std::string_view value) {
+            if (source != ValueSource::defaultValue) {
+                return ParseError::duplicateOption;
             }
+            slot = value;
+            source = ValueSource::commandLine;
+            return ParseError::none;
         }
 
-        // checking that positionnal arg is set
-        if (!positionalOption.name.empty()) {
-            assert(result[positionalOption.name].empty());
-            std::cerr << "Error: missing '" << positionalOption.name << "' value (" << positionalOption.description << ").\n";
-            priv::displayHelpMessage(argv[0], options);
-            std::exit(1);
+        template <class Args>
+        bool parseArgs(const SchemaView & schema, const Args & args, ParseStatus & status, OptionValues & values, int * stopIndex);
+
+        bool applyEnvironment(const SchemaView & schema, const Environment & environment, ParseStatus & status, OptionValues & values);
+
+        bool applySettings(const SchemaView & schema, const Settings & settings, ParseStatus & status, OptionValues & values);
+
+        template <class Args>
+        bool parseLayers(const SchemaView & schema, const Args & args, const Layers & layers, ParseResult & result);
+
+        inline char ** environmentVariables() {
+#ifdef _WIN32
+            return _environ;
+#else
+            return environ;
+#endif
+        }
+    }
+
+    // environment variables from which options not given on the command line can take their value,
+    // see Parser::tryParse()
+    struct Environment {
+        std::string_view prefix;                                 // e.g. "MYTOOL_"
+        char ** variables = priv::environmentVariables();        // "NAME=value", null terminated
+    };
+
+    // "key = value" setting, key being the name of an option or one of its flags
+    struct Setting {
+        std::string_view key;
+        std::string_view value;
+        int line = 0; // reported as errorIndex if the setting is invalid
+    };
+
+    // settings from which options given neither on the command line nor in the environment can take
+    // their value, e.g. read from a configuration file; keys and values are views which must outlive
+    // the parse results
+    class Settings {
+    public:
+        explicit Settings(std::pmr::memory_resource * resource = std::pmr::get_default_resource()) : entries(resource) {}
+
+        void add(std::string_view key, std::string_view value, int line = 0) {
+            entries.push_back(Setting{ key, value, line });
         }
 
+        void clear() { entries.clear(); }
+        size_t size() const { return entries.size(); }
+        const Setting * begin() const { return entries.data(); }
+        const Setting * end() const { return entries.data() + entries.size(); }
+
+    private:
+        std::pmr::vector<Setting> entries;
+    };
+
+    // sources of lower priority than the command line, each one only filling the options that the
+    // previous ones did not set: environment, then settings, then default values
+    struct Layers {
+        const Environment * environment = nullptr;
+        const Settings * settings = nullptr;
+    };
+
+    // option resolved once by name or flag, to access its value by index instead of by key
+    struct OptionHandle {
+        uint32_t index = priv::npos;
+    };
+
+    // outcome of a parse
+    struct ParseStatus {
+        ParseError error = ParseError::none;
+        int errorIndex = 0; // index in argv of the offending argument (argc if it is missing), or in
+                            // the Arguments parsed (see Arguments::argvIndex()), -1 for the
+                            // environment, line of the setting for settings
+        OptionHandle errorOption; // option concerned by the error, if any
+        ValueSource errorSource = ValueSource::commandLine; // where the offending value comes from
+
+        explicit operator bool() const { return error == ParseError::none; }
+    };
+
+    // contiguous values of an option, valid as long as the OptionValues which returned them
+    class ValueList {
+    public:
+        ValueList() = default;
+        ValueList(const std::string_view * first, size_t count) : first(first), count(count) {}
+
+        const std::string_view * begin() const { return first; }
+        const std::string_view * end() const { return first + count; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        std::string_view operator[](size_t i) const {
+            assert(i < count);
+            return first[i];
+        }
+
+    private:
+        const std::string_view * first = nullptr;
+        size_t count = 0;
+    };
+
+    // option values after parsing: views into argv or into the default values held by the Parser
+    // (or StaticSchema), so both must outlive it
+    class OptionValues {
+    public:
+        OptionValues() = default;
+
+        // the slots are allocated from resource
+        explicit OptionValues(std::pmr::memory_resource * resource) : slots(resource), typedSlots(resource), lists(resource), listOwners(resource), sortedLists(resource), listRefs(resource), sources(resource) {}
+
+        // key is either the name of an option or one of its flags (empty if unknown)
+        std::string_view operator[](std::string_view key) const {
+            assert(schema.keyTable != nullptr);
+            const uint32_t index = schema.findKey(key);
+            return (index != priv::npos) ? slots[index] : std::string_view{};
+        }
+
+        // handle obtained from the Parser (or StaticSchema) which produced these values
+        std::string_view operator[](OptionHandle option) const {
+            assert(option.index < slots.size());
+            return slots[option.index];
+        }
+
+        // converted values, for options declared with the matching ValueType
+        int64_t asInteger(OptionHandle option) const {
+            return typed(option, ValueType::integer).integer;
+        }
+
+        uint64_t asUnsigned(OptionHandle option) const {
+            return typed(option, ValueType::unsignedInteger).unsignedInteger;
+        }
+
+        double asFloating(OptionHandle option) const {
+            return typed(option, ValueType::floating).floating;
+        }
+
+        bool asBool(OptionHandle option) const {
+            return typed(option, ValueType::boolean).integer != 0;
+        }
+
+        // index of the value in the list of choices, -1 if not given and without default
+        int asChoice(OptionHandle option) const {
+            return static_cast<int>(typed(option, ValueType::choice).integer);
+        }
+
+        // number of options, handles being 0 to size() - 1
+        size_t size() const { return slots.size(); }
+
+        // where the value of an option comes from
+        ValueSource source(OptionHandle option) const {
+            assert(option.index < sources.size());
+            return sources[option.index];
+        }
+
+        // all the values given to an option declared with a "..." name suffix, in command line
+        // order (the other accessors return the first one), or its default value if none was
+        // given; for other options, the same value as operator[], if not empty
+        ValueList list(OptionHandle option) const {
+            assert(option.index < slots.size());
+            const priv::ListRef & ref = listRefs[option.index];
+            if (ref.count != 0) {
+                return ValueList(lists.data() + ref.first, ref.count);
+            }
+            const std::string_view & slot = slots[option.index];
+            return ValueList(&slot, slot.empty() ? 0 : 1);
+        }
+
+        ValueList list(std::string_view key) const {
+            assert(schema.keyTable != nullptr);
+            const uint32_t index = schema.findKey(key);
+            return (index != priv::npos) ? list(OptionHandle{ index }) : ValueList{};
+        }
+
+    private:
+        template <class Args>
+        friend bool priv::parseArgs(const priv::SchemaView &, const Args &, ParseStatus &, OptionValues &, int *);
+        friend bool priv::applyEnvironment(const priv::SchemaView &, const Environment &, ParseStatus &, OptionValues &);
+        friend bool priv::applySettings(const priv::SchemaView &, const Settings &, ParseStatus &, OptionValues &);
+        template <class Args>
+        friend bool priv::parseLayers(const priv::SchemaView &, const Args &, const Layers &, ParseResult &);
+
+        // value of an option from a source of lower priority than the command line, ignored
+        // (not even converted) if a source of higher priority set the option; an option taking
+        // several values gets all those of its source, another one only once per source
+        ParseError setFromSource(uint32_t index, std::string_view value, ValueSource source) {
+            if (sources[index] > source) {
+                return ParseError::none;
+            }
+            const auto & opt = schema.options[index];
+            if (sources[index] == source && !opt.repeated) {
+                return ParseError::duplicateOption;
+            }
+            priv::TypedValue converted;
+            const ParseError error = priv::convertValue(opt.type, schema.str(opt.choices), value, converted);
+            if (error != ParseError::none) {
+                return error;
+            }
+            if (opt.repeated) {
+                priv::ListRef & list = listRefs[index];
+                ungroupedLists = ungroupedLists || (list.count != 0 && list.first + list.count != lists.size());
+                list.first = (list.count == 0) ? static_cast<uint32_t>(lists.size()) : list.first;
+                ++list.count;
+                lists.push_back(value);
+                listOwners.push_back(index);
+                if (sources[index] == source) {
+                    return ParseError::none; // the typed value is the first one
+                }
+            }
+            slots[index] = value;
+            typedSlots[index] = converted;
+            sources[index] = source;
+            return ParseError::none;
+        }
+
+        // checking that the positional options without default value are set
+        bool checkPositionals(ParseStatus & status, int argc) const {
+            for (uint32_t i = schema.positionalIndex; i != priv::npos; i = schema.nextPositional(i)) {
+                if (sources[i] == ValueSource::defaultValue && schema.options[i].defaultValue.length == 0) {
+                    status.error = ParseError::missingPositional;
+                    status.errorIndex = argc;
+                    status.errorOption = OptionHandle{ i };
+                    status.errorSource = ValueSource::commandLine;
+                    return false;
+                }
+            }
+            status = ParseStatus{};
+            return true;
+        }
+
+        const priv::TypedValue & typed(OptionHandle option, ValueType::Kind type) const {
+            assert(option.index < slots.size());
+            assert(schema.options[option.index].type == type);
+            (void)type;
+            return typedSlots[option.index];
+        }
+
+        // make the values of each option contiguous in lists, keeping their order (counting sort)
+        void groupLists() {
+            uint32_t first = 0;
+            for (auto & ref : listRefs) {
+                ref.first = first;
+                first += ref.count;
+            }
+            sortedLists.reserve(lists.capacity()); // lists gets this buffer: keep room for as many values
+            sortedLists.resize(lists.size());
+            for (size_t i = 0; i < lists.size(); ++i) {
+                sortedLists[listRefs[listOwners[i]].first++] = lists[i];
+            }
+            for (auto & ref : listRefs) {
+                ref.first -= ref.count;
+            }
+            lists.swap(sortedLists);
+            for (uint32_t option = 0; option < listRefs.size(); ++option) {
+                std::fill_n(listOwners.begin() + listRefs[option].first, listRefs[option].count, option);
+            }
+            ungroupedLists = false;
+        }
+
+        priv::SchemaView schema;
+        std::pmr::vector<std::string_view> slots;       // one per option, in declaration order
+        std::pmr::vector<priv::TypedValue> typedSlots;  // same, only meaningful for typed options
+        std::pmr::vector<std::string_view> lists;       // values of the options taking several values
+        std::pmr::vector<uint32_t> listOwners;          // option of each value in lists
+        std::pmr::vector<std::string_view> sortedLists; // scratch buffer of groupLists()
+        std::pmr::vector<priv::ListRef> listRefs;       // one per option, where its values are in lists
+        std::pmr::vector<ValueSource> sources;          // one per option
+        bool ungroupedLists = false;                    // lists to group, see setFromSource()
+    };
+
+    struct ParseResult : ParseStatus {
+        ParseResult() = default;
+        explicit ParseResult(std::pmr::memory_resource * resource) : values(resource) {}
+
+        OptionValues values;
+    };
+
+    namespace priv {
+        // identity of a file, to detect response files including themselves
+        struct FileId {
+            uint64_t device = 0;
+            uint64_t index = 0;
+
+            bool operator==(const FileId & other) const { return device == other.device && index == other.index; }
+        };
+
+        // copy-on-write mapping of a whole file: the content can be modified in place, only the
+        // modified pages being copied, and the file itself is never written
+        class MappedFile {
+        public:
+            MappedFile() = default;
+            MappedFile(const MappedFile &) = delete;
+            MappedFile & operator=(const MappedFile &) = delete;
+            MappedFile(MappedFile && other) noexcept : id(other.id), mapping(other.mapping), length(other.length) {
+                other.mapping = nullptr;
+                other.length = 0;
+            }
+            MappedFile & operator=(MappedFile && other) noexcept {
+                std::swap(id, other.id);
+                std::swap(mapping, other.mapping);
+                std::swap(length, other.length);
+                return *this;
+            }
+            ~MappedFile() { unmap(); }
+
+            // return false if the file cannot be read
+            bool open(const std::string & path);
+
+            char * data() const { return mapping; }
+            size_t size() const { return length; }
+
+            FileId id;
+
+        private:
+            void unmap();
+
+            char * mapping = nullptr;
+            size_t length = 0;
+        };
+
+#ifdef _WIN32
+        inline bool MappedFile::open(const std::string & path) {
+            unmap();
+            const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            BY_HANDLE_FILE_INFORMATION info;
+            bool ok = GetFileInformationByHandle(file, &info) != 0;
+            if (ok) {
+                id.device = info.dwVolumeSerialNumber;
+                id.index = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+                const uint64_t fileSize = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+                if (fileSize > 0) {
+                    const HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+                    void * view = fileMapping ? MapViewOfFile(fileMapping, FILE_MAP_COPY, 0, 0, 0) : nullptr;
+                    if (fileMapping) {
+                        CloseHandle(fileMapping);
+                    }
+                    ok = (view != nullptr);
+                    if (ok) {
+                        mapping = static_cast<char *>(view);
+                        length = static_cast<size_t>(fileSize);
+                    }
+                }
+            }
+            CloseHandle(file);
+            return ok;
+        }
+
+        inline void MappedFile::unmap() {
+            if (mapping) {
+                UnmapViewOfFile(mapping);
+            }
+            mapping = nullptr;
+            length = 0;
+        }
+#else
+        inline bool MappedFile::open(const std::string & path) {
+            unmap();
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            bool ok = (fstat(fd, &info) == 0) && S_ISREG(info.st_mode);
+            if (ok) {
+                id.device = static_cast<uint64_t>(info.st_dev);
+                id.index = static_cast<uint64_t>(info.st_ino);
+                if (info.st_size > 0) {
+                    const size_t fileSize = static_cast<size_t>(info.st_size);
+                    void * view = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                    ok = (view != MAP_FAILED);
+                    if (ok) {
+                        mapping = static_cast<char *>(view);
+                        length = fileSize;
+                    }
+                }
+            }
+            ::close(fd);
+            return ok;
+        }
+
+        inline void MappedFile::unmap() {
+            if (mapping) {
+                munmap(mapping, length);
+            }
+            mapping = nullptr;
+            length = 0;
+        }
+#endif
+
+        inline bool isBlank(char c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+        }
+
+        // split [data, data + size) into arguments separated by blanks, in place: quotes ('' or "")
+        // group blanks into an argument and a backslash escapes the next character; removing them
+        // shifts the rest of the argument, so only the arguments using them are written to
+        template <class OnToken>
+        void tokenize(char * data, size_t size, OnToken && onToken) {
+            const char * end = data + size;
+            char * p = data;
+            while (true) {
+                while (p != end && isBlank(*p)) {
+                    ++p;
+                }
+                if (p == end) {
+                    return;
+                }
+                char * const start = p;
+                char * out = p; // out != p once a quote or a backslash has been removed
+                char quote = 0;
+                for (; p != end; ++p) {
+                    const char c = *p;
+                    if (c == '\\' && p + 1 != end && quote != '\'') {
+                        ++p;
+                    }
+                    else if (quote ? (c == quote) : (c == '"' || c == '\'')) {
+                        quote = quote ? 0 : c;
+                        continue;
+                    }
+                    else if (!quote && isBlank(c)) {
+                        break;
+                    }
+                    if (out != p) {
+                        *out = *p;
+                    }
+                    ++out;
+                }
+                onToken(std::string_view(start, static_cast<size_t>(out - start)));
+            }
+        }
+    }
+
+    // command line with its response files expanded: each "@file" argument is replaced by the
+    // arguments found in file, which can themselves be "@file" arguments (relative to the current
+    // directory); files are mapped in memory and the arguments refer to them, so they stay valid
+    // as long as the Arguments object and are not copied
+    class Arguments {
+    public:
+        Arguments() = default;
+        explicit Arguments(std::pmr::memory_resource * resource) : files(resource), args(resource), origins(resource), openFiles(resource) {}
+
+        // print a message then exit the program if a response file cannot be read
+        void expand(int argc, char *argv[]) {
+            const ParseStatus status = tryExpand(argc, argv);
+            if (status.error == ParseError::unreadableResponseFile) {
+                std::cerr << "Error: cannot read response file '" << failedFile << "'.\n";
+                std::exit(1);
+            }
+            if (status.error == ParseError::responseFileCycle) {
+                std::cerr << "Error: response file '" << failedFile << "' includes itself.\n";
+                std::exit(1);
+            }
+        }
+
+        // never exit nor print anything: on error, errorIndex is the index in argv of the "@file"
+        // argument which lead to the faulty file, named by errorFile()
+        ParseStatus tryExpand(int argc, char *argv[]);
+
+        const std::string & errorFile() const { return failedFile; }
+
+        size_t size() const { return args.size(); }
+        std::string_view operator[](size_t i) const { return args[i]; }
+
+        // index in argv of the i-th argument, or of the "@file" argument it was read from (argc
+        // for size()): errors of a parse of these Arguments have their index in them, which no
+        // longer matches argv once a file was expanded
+        int argvIndex(size_t i) const { return (i < origins.size()) ? origins[i] : argvCount; }
+
+    private:
+        ParseError expandFile(std::string_view path, int origin);
+
+        std::pmr::vector<priv::MappedFile> files;
+        std::pmr::vector<std::string_view> args;
+        std::pmr::vector<int> origins; // index in argv of each argument, see argvIndex()
+        int argvCount = 0;
+        std::pmr::vector<priv::FileId> openFiles; // files being expanded, to detect cycles
+        std::string failedFile;
+    };
+
+    inline ParseStatus Arguments::tryExpand(int argc, char *argv[]) {
+        files.clear();
+        args.clear();
+        origins.clear();
+        openFiles.clear();
+        failedFile.clear();
+        args.reserve(static_cast<size_t>(argc));
+        origins.reserve(static_cast<size_t>(argc));
+        argvCount = argc;
+
+        ParseStatus status;
+        for (int i = 0; i < argc; ++i) {
+            const std::string_view arg = argv[i];
+            if (i > 0 && arg.size() > 1 && arg.front() == '@') {
+                status.error = expandFile(arg.substr(1), i);
+                if (status.error != ParseError::none) {
+                    status.errorIndex = i;
+                    return status;
+                }
+            }
+            else {
+                args.push_back(arg);
+                origins.push_back(i);
+            }
+        }
+        return status;
+    }
+
+    inline ParseError Arguments::expandFile(std::string_view path, int origin) {
+        priv::MappedFile file;
+        if (!file.open(std::string(path))) {
+            failedFile = path;
+            return ParseError::unreadableResponseFile;
+        }
+        for (const priv::FileId & id : openFiles) {
+            if (id == file.id) {
+                failedFile = path;
+                return ParseError::responseFileCycle;
+            }
+        }
+
+        // moving the MappedFile keeps the mapping where it is
+        files.push_back(std::move(file));
+        openFiles.push_back(files.back().id);
+        ParseError error = ParseError::none;
+        priv::tokenize(files.back().data(), files.back().size(), [this, &error, origin](std::string_view token) {
+            if (error != ParseError::none) {
+                return;
+            }
+            if (token.size() > 1 && token.front() == '@') {
+                error = expandFile(token.substr(1), origin);
+            }
+            else {
+                args.push_back(token);
+                origins.push_back(origin);
+            }
+        });
+        openFiles.pop_back();
+        return error;
+    }
+
+    // settings read from a "name = value" file, mapped in memory: keys and values are views into the
+    // mapping, so the ConfigFile must outlive the parse results using it; blanks around them, empty
+    // lines, comments (lines starting with '#' or ';') and "[section]" lines are ignored
+    // the file must not be truncated while mapped: update it by renaming a new file over it
+    class ConfigFile : public Settings {
+    public:
+        ConfigFile() = default;
+        explicit ConfigFile(std::pmr::memory_resource * resource) : Settings(resource) {}
+
+        // print a message then exit the program if the file cannot be read or has an invalid line
+        void load(const std::string & path) {
+            const ParseStatus status = tryLoad(path);
+            if (status.error == ParseError::unreadableConfigFile) {
+                std::cerr << "Error: cannot read configuration file '" << path << "'.\n";
+                std::exit(1);
+            }
+            if (status.error == ParseError::invalidSetting) {
+                std::cerr << "Error: invalid setting at line " << status.errorIndex << " of '" << path << "', expected 'name = value'.\n";
+                std::exit(1);
+            }
+        }
+
+        // never exit nor print anything: on error, errorIndex is the line of the invalid setting;
+        // the keys are checked against the options when parsing (see Layers)
+        ParseStatus tryLoad(const std::string & path);
+
+    private:
+        priv::MappedFile file;
+    };
+
+    inline ParseStatus ConfigFile::tryLoad(const std::string & path) {
+        clear();
+        ParseStatus status;
+        status.errorSource = ValueSource::configFile;
+        if (!file.open(path)) {
+            status.error = ParseError::unreadableConfigFile;
+            return status;
+        }
+        const auto trim = [](const char * first, const char * last) {
+            while (first != last && priv::isBlank(*first)) {
+                ++first;
+            }
+            while (last != first && priv::isBlank(last[-1])) {
+                --last;
+            }
+            return std::string_view(first, static_cast<size_t>(last - first));
+        };
+
+        // memchr() finds the end of each line then its '=', a word at a time
+        const char * p = file.data();
+        const char * const end = p + file.size();
+        for (int line = 1; p != end; ++line) {
+            const char * lineEnd = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            lineEnd = lineEnd ? lineEnd : end;
+            const std::string_view text = trim(p, lineEnd);
+            p = (lineEnd == end) ? end : lineEnd + 1;
+            if (text.empty() || text.front() == '#' || text.front() == ';' || (text.front() == '[' && text.back() == ']')) {
+                continue;
+            }
+            const char * equal = static_cast<const char *>(std::memchr(text.data(), '=', text.size()));
+            const std::string_view key = equal ? trim(text.data(), equal) : std::string_view{};
+            if (key.empty()) {
+                status.error = ParseError::invalidSetting;
+                status.errorIndex = line;
+                return status;
+            }
+            add(key, trim(equal + 1, text.data() + text.size()), line);
+        }
+        return status;
+    }
+
+    namespace priv {
+        // "-f=value": split arg at its first '=' (flags never contain one) and hash the flag part
+        // in the same pass; hasValue tells if there was a '='
+        constexpr uint64_t splitFlag(std::string_view arg, std::string_view & flag, std::string_view & value, bool & hasValue) {
+            uint64_t hash = 14695981039346656037ull;
+            size_t i = 0;
+            for (; i < arg.size() && arg[i] != '='; ++i) {
+                hash = (hash ^ static_cast<uint8_t>(arg[i])) * 1099511628211ull;
+            }
+            hasValue = (i < arg.size());
+            flag = arg.substr(0, i);
+            value = hasValue ? arg.substr(i + 1) : std::string_view{};
+            return hash;
+        }
+
+        // the arguments of a subcommand, args[first] being its name
+        template <class Args>
+        struct ArgsTail {
+            const Args & args;
+            size_t first;
+
+            size_t size() const { return args.size() - first; }
+            std::string_view operator[](size_t i) const { return args[first + i]; }
+        };
+
+        // the count first arguments
+        template <class Args>
+        struct ArgsHead {
+            const Args & args;
+            size_t count;
+
+            size_t size() const { return count; }
+            std::string_view operator[](size_t i) const { return args[i]; }
+        };
+
+        // argv seen as a list of arguments, like Arguments
+        struct ArgvList {
+            int argc;
+            char ** argv;
+
+            size_t size() const { return static_cast<size_t>(argc); }
+            std::string_view operator[](size_t i) const { return argv[i]; }
+        };
+
+        // walk the arguments (args[0] being the program name) and call onValue(option index, value)
+        // for each value given, which returns ParseError::none to continue; flags receive "true"
+        // with a stopIndex, the first argument which no positional option can take ends the scan
+        // (*stopIndex is its index, or argc) instead of being an unexpectedValue error
+        template <class Args, class OnValue>
+        bool scanArgs(const SchemaView & schema, const Args & args, ParseStatus & status, OnValue && onValue, int * stopIndex = nullptr) {
+            const int argc = static_cast<int>(args.size());
+            int end = argc;
+            uint32_t positional = schema.positionalIndex;
+            bool positionalGiven = false; // the last positional option received a value
+
+            const auto fail = [&status](ParseError error, int index, uint32_t option = npos) {
+                status.error = error;
+                status.errorIndex = index;
+                status.errorOption = OptionHandle{ option };
+                status.errorSource = ValueSource::commandLine;
+                return false;
+            };
+
+            // option given by a flag, with its value if any: args[i] is the flag, the next argument
+            // is consumed if needed
+            const auto takeOption = [&](uint32_t index, bool hasValue, std::string_view value, int & i) {
+                switch (schema.options[index].kind) {
+                // process reserved names
+                case OptionKind::help:
+                    return fail(ParseError::helpRequested, i, index);
+                case OptionKind::version:
+                    return fail(ParseError::versionRequested, i, index);
+                // process named options
+                case OptionKind::value: {
+                    // we expect a value for named options, "-f=value" or "-f value"
+                    const int flagIndex = i;
+                    if (!hasValue) {
+                        if (i + 1 == argc || (!args[i + 1].empty() && args[i + 1].front() == '-')) {
+                            return fail(ParseError::missingValue, i, index);
+                        }
+                        ++i;
+                        value = args[i];
+                    }
+                    const ParseError error = onValue(index, value);
+                    return (error == ParseError::none) || fail(error, (error == ParseError::duplicateOption) ? flagIndex : i, index);
+                }
+                // process flags
+                case OptionKind::flag: {
+                    // "-f=false" is allowed too
+                    const ParseError error = onValue(index, hasValue ? value : "true");
+                    return (error == ParseError::none) || fail(error, i, index);
+                }
+                case OptionKind::positional:
+                    assert(false);
+                    break;
+                }
+                return true;
+            };
+
+            // process the given command line
+            for (int i = 1; i < argc; ++i) {
+                const std::string_view arg = args[i];
+                if (!arg.empty() && arg.front() == '-') {
+                    std::string_view flag, value;
+                    bool hasValue = false;
+                    const uint64_t hash = splitFlag(arg, flag, value, hasValue);
+                    uint32_t index = schema.findKey(flag, hash);
+                    // option names never start with '-' so only flags can match here
+                    if (index == npos && flag.size() > 2 && flag[1] == '-') {
+                        // "--verb" for "--verbose": unique prefix of a long flag
+                        index = schema.findPrefix(flag);
+                        if (index == ambiguous) {
+                            return fail(ParseError::ambiguousOption, i);
+                        }
+                        if (index == npos) {
+                            return fail(ParseError::unknownOption, i);
+                        }
+                    }
+                    else if (index == npos) {
+                        if (flag.size() < 3) {
+                            return fail(ParseError::unknownOption, i);
+                        }
+                        // "-xvf" or "-ofile": bundle of single character flags, one table load per
+                        // character; the last one (or the first taking a value) is processed below
+                        for (size_t c = 1; c < flag.size(); ++c) {
+                            index = schema.shortFlags[static_cast<uint8_t>(flag[c])];
+                            if (index == npos) {
+                                return fail(ParseError::unknownOption, i);
+                            }
+                            if (c + 1 == flag.size()) {
+                                break;
+                            }
+                            if (schema.options[index].kind == OptionKind::value) {
+                                // the rest of the argument is the value ("-vo=file" is allowed too)
+                                value = arg.substr(c + 1);
+                                value = (value.front() == '=') ? value.substr(1) : value;
+                                hasValue = true;
+                                break;
+                            }
+                            if (!takeOption(index, false, {}, i)) {
+                                return false;
+                            }
+                        }
+                    }
+                    if (!takeOption(index, hasValue, value, i)) {
+                        return false;
+                    }
+                }
+                else if (positional != npos) {
+                    const ParseError error = onValue(positional, arg);
+                    if (error != ParseError::none) {
+                        return fail(error, i, positional);
+                    }
+                    // positional options receive one value each, in declaration order, except the
+                    // last one which can take all the remaining values
+                    positionalGiven = schema.options[positional].repeated;
+                    positional = positionalGiven ? positional : schema.nextPositional(positional);
+                }
+                else if (stopIndex) {
+                    end = i;
+                    break;
+                }
+                else {
+                    return fail(ParseError::unexpectedValue, i);
+                }
+            }
+            if (stopIndex) {
+                *stopIndex = end;
+            }
+
+            // checking that the positional options without default value are set
+            if (positionalGiven) {
+                positional = schema.nextPositional(positional);
+            }
+            for (; positional != npos; positional = schema.nextPositional(positional)) {
+                if (schema.options[positional].defaultValue.length == 0) {
+                    return fail(ParseError::missingPositional, end, positional);
+                }
+            }
+            status = ParseStatus{};
+            return true;
+        }
+
+        template <class Args>
+        bool parseArgs(const SchemaView & schema, const Args & args, ParseStatus & status, OptionValues & values, int * stopIndex) {
+            auto & slots = values.slots;
+            auto & typedSlots = values.typedSlots;
+            auto & lists = values.lists;
+            auto & listRefs = values.listRefs;
+            values.schema = schema;
+            slots.resize(schema.optionCount);
+            typedSlots.resize(schema.optionCount);
+            listRefs.resize(schema.optionCount);
+            values.sources.resize(schema.optionCount);
+            for (uint32_t i = 0; i < schema.optionCount; ++i) {
+                slots[i] = schema.str(schema.options[i].defaultValue);
+                typedSlots[i] = schema.options[i].defaultTyped;
+                listRefs[i] = ListRef{};
+                values.sources[i] = ValueSource::defaultValue;
+            }
+            values.ungroupedLists = false;
+            // there cannot be more values than arguments
+            auto & listOwners = values.listOwners;
+            lists.clear();
+            listOwners.clear();
+            lists.reserve(args.size());
+            listOwners.reserve(args.size());
+            bool interleaved = false; // the values of an option are not contiguous
+            const bool ok = scanArgs(schema, args, status, [&](uint32_t index, std::string_view value) {
+                const auto & opt = schema.options[index];
+                if (opt.repeated) {
+                    auto & list = listRefs[index];
+                    list.first = (list.count == 0) ? static_cast<uint32_t>(lists.size()) : list.first;
+                    interleaved = interleaved || (list.count != 0 && listOwners.back() != index);
+                    lists.push_back(value);
+                    listOwners.push_back(index);
+                    if (list.count++ != 0) {
+                        // the following values are only checked: the typed value is the first one
+                        TypedValue ignored;
+                        return convertValue(opt.type, schema.str(opt.choices), value, ignored);
+                    }
+                }
+                const ParseError error = priv::setValue(slots[index], values.sources[index], value);
+                if (error != ParseError::none) {
+                    return error;
+                }
+                return convertValue(opt.type, schema.str(opt.choices), value, typedSlots[index]);
+            }, stopIndex);
+            if (interleaved) {
+                values.groupLists();
+            }
+            return ok;
+        }
+
+        template <class Args>
+        bool parseArgs(const SchemaView & schema, const Args & args, ParseResult & result) {
+            return parseArgs(schema, args, result, result.values, nullptr);
+        }
+
+        // option named flag without its "--" prefix, else having flag
+        inline uint32_t findNamedOption(const SchemaView & schema, std::string_view flag) {
+            const uint32_t index = schema.findKey(flag.substr(2));
+            return (index == npos) ? schema.findKey(flag) : index;
+        }
+
+        // fill the options not set yet from the variables named prefix + NAME, NAME being the name
+        // of the option (or its long flag without "--") in upper case with '-' replaced by '_'; the
+        // environment is scanned once, each variable being looked up in the flag index
+        inline bool applyEnvironment(const SchemaView & schema, const Environment & environment, ParseStatus & status, OptionValues & values) {
+            if (environment.variables == nullptr) {
+                return true;
+            }
+            const std::string_view prefix = environment.prefix;
+            char key[256] = { '-', '-' }; // "--name", converted from NAME
+            for (char ** variable = environment.variables; *variable != nullptr; ++variable) {
+                const std::string_view entry = *variable;
+                const size_t equal = entry.find('=');
+                if (equal == std::string_view::npos || equal <= prefix.size() || equal - prefix.size() > sizeof(key) - 2 ||
+                    entry.substr(0, prefix.size()) != prefix) {
+                    continue;
+                }
+                const size_t length = equal - prefix.size();
+                for (size_t i = 0; i < length; ++i) {
+                    const char c = entry[prefix.size() + i];
+                    key[2 + i] = (c == '_') ? '-' : (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+                }
+                const uint32_t index = findNamedOption(schema, std::string_view(key, length + 2));
+                if (index == npos || schema.options[index].kind == OptionKind::help || schema.options[index].kind == OptionKind::version) {
+                    continue;
+                }
+                const ParseError error = values.setFromSource(index, entry.substr(equal + 1), ValueSource::environment);
+                if (error != ParseError::none) {
+                    status.error = error;
+                    status.errorIndex = -1;
+                    status.errorOption = OptionHandle{ index };
+                    status.errorSource = ValueSource::environment;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // fill the options not set yet from the settings, whose keys are flags or option names
+        // (or long flags without "--"); an unknown key is an error, and so is a second setting of an
+        // option taking a single value (the options taking several values get all of them)
+        inline bool applySettings(const SchemaView & schema, const Settings & settings, ParseStatus & status, OptionValues & values) {
+            char key[256] = { '-', '-' };
+            for (const Setting & setting : settings) {
+                uint32_t index = npos;
+                if (!setting.key.empty() && setting.key[0] == '-') {
+                    index = schema.findKey(setting.key);
+                }
+                else if (setting.key.size() <= sizeof(key) - 2) {
+                    setting.key.copy(key + 2, setting.key.size());
+                    index = findNamedOption(schema, std::string_view(key, setting.key.size() + 2));
+                }
+                ParseError error = ParseError::unknownOption;
+                if (index != npos) {
+                    const OptionKind kind = schema.options[index].kind;
+                    if (kind == OptionKind::help || kind == OptionKind::version) {
+                        continue;
+                    }
+                    error = values.setFromSource(index, setting.value, ValueSource::configFile);
+                }
+                if (error != ParseError::none) {
+                    status.error = error;
+                    status.errorIndex = setting.line;
+                    status.errorOption = OptionHandle{ index };
+                    status.errorSource = ValueSource::configFile;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // the command line, then each layer for the options not set by the previous ones: values
+        // are written into their slot (or appended to their list) by the first layer giving them,
+        // and never converted if a higher layer already set them
+        template <class Args>
+        bool parseLayers(const SchemaView & schema, const Args & args, const Layers & layers, ParseResult & result) {
+            if (!parseArgs(schema, args, result) && result.error != ParseError::missingPositional) {
+                return false;
+            }
+            if (layers.environment && !applyEnvironment(schema, *layers.environment, result, result.values)) {
+                return false;
+            }
+            if (layers.settings && !applySettings(schema, *layers.settings, result, result.values)) {
+                return false;
+            }
+            if (result.values.ungroupedLists) {
+                result.values.groupLists();
+            }
+            return result.values.checkPositionals(result, static_cast<int>(args.size()));
+        }
+
+        // adapt a visitor of Parser::visit() to scanArgs()
+        template <class Args, class Visitor>
+        bool visitArgs(const SchemaView & schema, const Args & args, ParseStatus & status, Visitor && visitor) {
+            return scanArgs(schema, args, status, [&visitor](uint32_t index, std::string_view value) {
+                visitor(OptionHandle{ index }, value);
+                return ParseError::none;
+            });
+        }
+
+        // print a message then exit the program on error, help or version request
+        template <class Args>
+        void exitOnError(const SchemaView & schema, const Args & args, const ParseStatus & result, const std::string & argv0) {
+            const priv::OptionEntry * opt = (result.errorOption.index != npos) ? &schema.options[result.errorOption.index] : nullptr;
+            switch (result.error) {
+            case ParseError::none:
+                break;
+            case ParseError::helpRequested:
+                displayHelpMessage(argv0, schema);
+                std::cout.flush();
+                std::exit(0);
+            case ParseError::versionRequested:
+                std::cout << schema.str(opt->defaultValue) << std::endl;
+                std::exit(0);
+            case ParseError::missingValue:
+                std::cerr << "Error: missing value for option '" << args[result.errorIndex] << "' (" << schema.str(opt->description) << ").\n";
+                std::exit(1);
+            case ParseError::invalidValue:
+            case ParseError::outOfRange:
+                std::cerr << "Error: " << ((result.error == ParseError::outOfRange) ? "out of range" : "invalid") << " value ";
+                if (result.errorSource == ValueSource::environment) {
+                    std::cerr << "in the environment ";
+                }
+                else if (result.errorSource == ValueSource::configFile) {
+                    std::cerr << "at line " << result.errorIndex << " of the settings ";
+                }
+                else {
+                    std::cerr << "'" << args[result.errorIndex] << "' ";
+                }
+                std::cerr << "(" << schema.str(opt->description) << ")";
+                if (opt->type == ValueType::choice) {
+                    std::cerr << ", expected one of: " << schema.str(opt->choices);
+                }
+                std::cerr << ".\n";
+                std::exit(1);
+            case ParseError::duplicateOption:
+                std::cerr << "Error: option ";
+                if (result.errorSource == ValueSource::environment) {
+                    std::cerr << "given more than once in the environment ";
+                }
+                else if (result.errorSource == ValueSource::configFile) {
+                    std::cerr << "given again at line " << result.errorIndex << " of the settings ";
+                }
+                else {
+                    std::cerr << "'" << args[result.errorIndex] << "' given more than once ";
+                }
+                std::cerr << "(" << schema.str(opt->description) << ").\n";
+                std::exit(1);
+            case ParseError::unknownOption:
+                if (result.errorSource == ValueSource::configFile) {
+                    std::cerr << "Error: unknown option at line " << result.errorIndex << " of the settings." << std::endl;
+                    std::exit(1);
+                }
+                std::cerr << "Error: unknown option '" << args[result.errorIndex] << "'" << std::endl;
+                displayHelpMessage(argv0, schema);
+                std::exit(1);
+            case ParseError::unexpectedValue:
+                std::cerr << "Error: unexpected value '" << args[result.errorIndex] << "'." << std::endl;
+                displayHelpMessage(argv0, schema);
+                std::exit(1);
+            case ParseError::missingPositional:
+                std::cerr << "Error: missing '" << schema.str(opt->name) << "' value (" << schema.str(opt->description) << ").\n";
+                displayHelpMessage(argv0, schema);
+                std::exit(1);
+            case ParseError::ambiguousOption: {
+                std::cerr << "Error: ambiguous option '" << args[result.errorIndex] << "', it could be:";
+                std::string_view flag, value;
+                bool hasValue = false;
+                splitFlag(args[result.errorIndex], flag, value, hasValue);
+                const char * separator = " ";
+                for (const std::string_view candidate : prefixCandidates(schema, flag)) {
+                    std::cerr << separator << candidate;
+                    separator = ", ";
+                }
+                std::cerr << ".\n";
+                std::exit(1);
+            }
+            case ParseError::unreadableResponseFile:
+            case ParseError::responseFileCycle:
+                break; // only reported by Arguments
+            case ParseError::missingCommand:
+            case ParseError::unknownCommand:
+                break; // only reported by Commands
+            case ParseError::unreadableConfigFile:
+            case ParseError::invalidSetting:
+                break; // only reported by ConfigFile
+            }
+        }
+
+        template <class Args>
+        OptionValues parseOrExit(const SchemaView & schema, const Args & args, const Layers * layers = nullptr) {
+            ParseResult result;
+            if (layers) {
+                parseLayers(schema, args, *layers, result);
+            }
+            else {
+                parseArgs(schema, args, result);
+            }
+            exitOnError(schema, args, result, std::string(args[0]));
+            return std::move(result.values);
+        }
+
+        // parse lines[i] into results[i] on threadCount threads: each takes the next chunk of lines
+        // from a shared counter until none are left, so faster threads take more of them
+        template <class Lines>
+        size_t parseBatch(const SchemaView & schema, const Lines & lines, ParseResult * results, unsigned threadCount) {
+            constexpr size_t chunkSize = 256;
+            const size_t lineCount = lines.size();
+            if (threadCount == 0) {
+                threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+            }
+            threadCount = static_cast<unsigned>((std::min<size_t>)(threadCount, (lineCount + chunkSize - 1) / chunkSize));
+
+            std::atomic<size_t> nextLine{ 0 };
+            std::atomic<size_t> errorCount{ 0 };
+            const auto work = [&] {
+                size_t errors = 0;
+                for (size_t first; (first = nextLine.fetch_add(chunkSize, std::memory_order_relaxed)) < lineCount;) {
+                    const size_t last = (std::min)(first + chunkSize, lineCount);
+                    for (size_t i = first; i < last; ++i) {
+                        errors += parseArgs(schema, lines[i], results[i]) ? 0 : 1;
+                    }
+                }
+                errorCount.fetch_add(errors, std::memory_order_relaxed);
+            };
+            // the calling thread works too
+            std::vector<std::thread> threads;
+            threads.reserve(threadCount);
+            for (unsigned t = 1; t < threadCount; ++t) {
+                threads.emplace_back(work);
+            }
+            work();
+            for (auto & thread : threads) {
+                thread.join();
+            }
+            return errorCount.load();
+        }
+
+        // parsing functions shared by Parser and StaticSchema, which provide view()
+        template <class Schema>
+        class SchemaFunctions {
+        public:
+            // print a message then exit the program on error, help or version request
+            OptionValues parse(int argc, char *argv[]) const {
+                return parseOrExit(view(), ArgvList{ argc, argv });
+            }
+
+            OptionValues parse(const Arguments & args) const {
+                return parseOrExit(view(), args);
+            }
+
+            // never exit nor print anything: the outcome is reported in the returned value
+            ParseResult tryParse(int argc, char *argv[], std::pmr::memory_resource * resource = std::pmr::get_default_resource()) const {
+                ParseResult result(resource);
+                parseArgs(view(), ArgvList{ argc, argv }, result);
+                return result;
+            }
+
+            ParseResult tryParse(const Arguments & args, std::pmr::memory_resource * resource = std::pmr::get_default_resource()) const {
+                ParseResult result(resource);
+                parseArgs(view(), args, result);
+                return result;
+            }
+
+            // same as above, reusing the memory of a previous result: once it has been used with
+            // this schema, neither parsing, converting values nor looking them up allocates memory
+            bool tryParse(int argc, char *argv[], ParseResult & result) const {
+                return parseArgs(view(), ArgvList{ argc, argv }, result);
+            }
+
+            bool tryParse(const Arguments & args, ParseResult & result) const {
+                return parseArgs(view(), args, result);
+            }
+
+            // same as above, the options not given on the command line taking their value from the
+            // environment (see Environment and priv::applyEnvironment()); these values are views
+            // into the environment, which must not change while they are used, and an invalid one is
+            // reported with errorIndex -1
+            OptionValues parse(int argc, char *argv[], const Environment & environment) const {
+                const Layers layers{ &environment };
+                return parseOrExit(view(), ArgvList{ argc, argv }, &layers);
+            }
+
+            bool tryParse(int argc, char *argv[], const Environment & environment, ParseResult & result) const {
+                return parseLayers(view(), ArgvList{ argc, argv }, Layers{ &environment }, result);
+            }
+
+            // same as above with all the layers (see Layers): the source of each value is given by
+            // OptionValues::source(); errors in settings are reported with their line as errorIndex
+            OptionValues parse(int argc, char *argv[], const Layers & layers) const {
+                return parseOrExit(view(), ArgvList{ argc, argv }, &layers);
+            }
+
+            bool tryParse(int argc, char *argv[], const Layers & layers, ParseResult & result) const {
+                return parseLayers(view(), ArgvList{ argc, argv }, layers, result);
+            }
+
+            OptionValues parse(const Arguments & args, const Layers & layers) const {
+                return parseOrExit(view(), args, &layers);
+            }
+
+            bool tryParse(const Arguments & args, const Layers & layers, ParseResult & result) const {
+                return parseLayers(view(), args, layers, result);
+            }
+
+            // stream the command line without building any result: visitor(OptionHandle,
+            // std::string_view) is called for each value in order, flags receiving "true"; values
+            // are not converted
+            template <class Visitor>
+            ParseStatus visit(int argc, char *argv[], Visitor && visitor) const {
+                ParseStatus status;
+                visitArgs(view(), ArgvList{ argc, argv }, status, visitor);
+                return status;
+            }
+
+            template <class Visitor>
+            ParseStatus visit(const Arguments & args, Visitor && visitor) const {
+                ParseStatus status;
+                visitArgs(view(), args, status, visitor);
+                return status;
+            }
+
+            // parse many command lines against this schema, which is only read, on threadCount threads
+            // (0: one per core); lines[i] is a list of arguments including the program name (e.g. a
+            // std::vector<std::string_view>, or Arguments) and results[i], preallocated by the
+            // caller, receives its outcome; return the number of lines in error
+            template <class Lines>
+            size_t parseBatch(const Lines & lines, ParseResult * results, unsigned threadCount = 0) const {
+                return priv::parseBatch(view(), lines, results, threadCount);
+            }
+
+            // long flags which prefix is the (abbreviated) flag given, e.g. after tryParse() reported
+            // ambiguousOption
+            std::vector<std::string_view> candidates(std::string_view prefix) const {
+                return prefixCandidates(view(), prefix);
+            }
+
+            // print the same message as "--help" would, e.g. after tryParse() reported helpRequested
+            void displayHelp(const std::string & argv0) const {
+                displayHelpMessage(argv0, view());
+            }
+
+        private:
+            constexpr SchemaView view() const {
+                return static_cast<const Schema &>(*this).view();
+            }
+        };
+    }
+
+    // compiled form of a list of ProgramOption: build it once, then call parse() as often as needed
+    // (parse(), tryParse(), visit() and displayHelp() come from priv::SchemaFunctions)
+    class Parser : public priv::SchemaFunctions<Parser> {
+        friend class Commands;
+
+    public:
+        // all the tables are allocated from resource, which must outlive the Parser
+        explicit Parser(const std::vector<ProgramOption> & options, std::pmr::memory_resource * resource = std::pmr::get_default_resource());
+
+        // key is either the name of an option or one of its flags, and must exist
+        OptionHandle option(std::string_view key) const {
+            const uint32_t index = view().findKey(key);
+            assert(index != priv::npos);
+            return OptionHandle{ index };
+        }
+
+    private:
+        friend class priv::SchemaFunctions<Parser>;
+        priv::SchemaView view() const;
+
+        // option strings packed in one buffer, and a perfect hash table of option names and flags
+        std::pmr::vector<char> chars;
+        std::pmr::vector<priv::OptionEntry> entries;
+        std::pmr::vector<priv::StringRef> keys;
+        std::pmr::vector<uint32_t> keyOptions;
+        std::pmr::vector<uint32_t> keyTable;
+        std::pmr::vector<uint32_t> displacements;
+        std::pmr::vector<uint32_t> shortFlags; // option of each single character flag, see buildShortFlags()
+        std::pmr::vector<priv::TrieNode> trie; // long flags, to match their prefixes
+        uint32_t positionalIndex;
+    };
+
+    inline Parser::Parser(const std::vector<ProgramOption> & options, std::pmr::memory_resource * resource)
+        : chars(resource), entries(resource), keys(resource), keyOptions(resource), keyTable(resource), displacements(resource), shortFlags(256, resource), trie(resource) {
+        assert(options.size() < priv::npos);
+        const uint32_t keyCount = priv::countKeys(options.data(), options.size());
+        chars.resize(priv::countChars(options.data(), options.size()));
+        entries.resize(options.size());
+        keys.resize(keyCount);
+        keyOptions.resize(keyCount);
+        positionalIndex = priv::storeOptions(options.data(), static_cast<uint32_t>(options.size()), chars.data(), entries.data(), keys.data(), keyOptions.data());
+        priv::buildShortFlags(chars.data(), entries.data(), static_cast<uint32_t>(entries.size()), keys.data(), shortFlags.data());
+        trie.resize(priv::countTrieNodes(options.data(), options.size()));
+        trie.resize(priv::buildPrefixTrie(chars.data(), entries.data(), static_cast<uint32_t>(entries.size()), keys.data(), trie.data()));
+
+        keyTable.resize(priv::keyTableSize(keyCount));
+        displacements.resize(priv::bucketCount(keyCount));
+        std::pmr::vector<uint32_t> bucketStarts(displacements.size() + 1, resource);
+        std::pmr::vector<uint32_t> bucketKeys(keyCount, resource);
+        priv::buildKeyTable(chars.data(), keys.data(), keyCount, keyTable.data(), static_cast<uint32_t>(keyTable.size()),
+                            displacements.data(), static_cast<uint32_t>(displacements.size()), bucketStarts.data(), bucketKeys.data());
+    }
+
+    inline priv::SchemaView Parser::view() const {
+        priv::SchemaView schema;
+        schema.chars = chars.data();
+        schema.options = entries.data();
+        schema.optionCount = static_cast<uint32_t>(entries.size());
+        schema.keys = keys.data();
+        schema.keyOptions = keyOptions.data();
+        schema.keyTable = keyTable.data();
+        schema.keyTableMask = static_cast<uint32_t>(keyTable.size() - 1);
+        schema.displacements = displacements.data();
+        schema.bucketMask = static_cast<uint32_t>(displacements.size() - 1);
+        schema.positionalIndex = positionalIndex;
+        schema.shortFlags = shortFlags.data();
+        schema.trie = trie.data();
+        return schema;
+    }
+
+    // a subcommand of a program ("tool build [options]"), see Commands
+    struct Command {
+        std::string name;
+        std::string description;
+        std::vector<ProgramOption> (*options)(); // only called if the command is selected
+    };
+
+    // outcome of Commands::tryParse()
+    struct CommandResult : ParseStatus {
+        CommandResult() = default;
+        explicit CommandResult(std::pmr::memory_resource * resource) : globals(resource), values(resource) {}
+
+        uint32_t command = priv::npos; // index of the selected command, in the list given to Commands
+        int commandIndex = 0;          // index in argv of the command name
+        bool errorInCommand = false;   // errorOption is an option of the command, not a global one
+        OptionValues globals;          // global options, given before the command name
+        OptionValues values;           // options of the command
+    };
+
+    // program with subcommands: "tool [global options] command [command options]", the command
+    // being the first argument that the global options do not take; the options of a command are
+    // compiled the first time it is selected, and the global ones are compiled once for all
+    class Commands {
+    public:
+        Commands(const std::vector<ProgramOption> & globalOptions, std::vector<Command> commandList,
+                 std::pmr::memory_resource * resource = std::pmr::get_default_resource());
+
+        // print a message then exit the program on error, help or version request
+        CommandResult parse(int argc, char *argv[]) {
+            return parseOrExit(priv::ArgvList{ argc, argv });
+        }
+
+        CommandResult parse(const Arguments & args) {
+            return parseOrExit(args);
+        }
+
+        // never exit nor print anything: the outcome is reported in result
+        bool tryParse(int argc, char *argv[], CommandResult & result) {
+            return tryParseArgs(priv::ArgvList{ argc, argv }, result);
+        }
+
+        bool tryParse(const Arguments & args, CommandResult & result) {
+            return tryParseArgs(args, result);
+        }
+
+        // multi-call program ("busybox style"): when called through a link named as one of the
+        // commands (basename of argv[0]), that command is selected and receives all the
+        // arguments, without global options; otherwise same as parse() ("tool command ...")
+        CommandResult parseMultiCall(int argc, char *argv[]) {
+            return parseOrExit(priv::ArgvList{ argc, argv }, true);
+        }
+
+        bool tryParseMultiCall(int argc, char *argv[], CommandResult & result) {
+            return tryParseMultiCallArgs(priv::ArgvList{ argc, argv }, result);
+        }
+
+        // index of a command, npos if unknown
+        uint32_t findCommand(std::string_view name) const {
+            return names.find(name);
+        }
+
+        // e.g. to get OptionHandle of the global options
+        const Parser & globalOptions() const {
+            return globals;
+        }
+
+        // options of a command, compiled on first use
+        const Parser & commandOptions(uint32_t command) {
+            assert(command < commands.size());
+            if (!compiled[command]) {
+                compiled[command].emplace(commands[command].options(), resource);
+            }
+            return *compiled[command];
+        }
+
+        // help of the global options followed by the list of commands
+        void displayHelp(const std::string & argv0) const {
+            priv::displayHelpMessage(argv0, globals.view(), " COMMAND [COMMAND OPTIONS]");
+            std::cout << "Commands:\n";
+            std::cout << "\n";
+            for (const auto & command : commands) {
+                const size_t paddingLength = (command.name.length() < 20) ? (20 - command.name.length()) : 0;
+                std::cout << "  " << command.name << std::string(paddingLength, ' ') << command.description << "\n";
+            }
+            std::cout << std::endl;
+        }
+
+    private:
+        static std::vector<std::string_view> commandNames(const std::vector<Command> & commands) {
+            std::vector<std::string_view> result;
+            for (const auto & command : commands) {
+                assert(!command.name.empty() && command.name.front() != '-');
+                assert(command.options != nullptr);
+                result.push_back(command.name);
+            }
+            return result;
+        }
+
+        template <class Args>
+        bool tryParseArgs(const Args & args, CommandResult & result);
+
+        template <class Args>
+        bool tryParseMultiCallArgs(const Args & args, CommandResult & result);
+
+        template <class Args>
+        CommandResult parseOrExit(const Args & args, bool multiCall = false);
+
+        std::pmr::memory_resource * resource;
+        Parser globals;
+        std::vector<Command> commands;
+        priv::NameIndex names;
+        std::vector<std::optional<Parser>> compiled; // one per command, empty until selected
+    };
+
+    inline Commands::Commands(const std::vector<ProgramOption> & globalOptions, std::vector<Command> commandList, std::pmr::memory_resource * resource)
+        : resource(resource), globals(globalOptions, resource), commands(std::move(commandList)), names(commandNames(commands), resource), compiled(commands.size()) {
+    }
+
+    template <class Args>
+    bool Commands::tryParseArgs(const Args & args, CommandResult & result) {
+        result.command = priv::npos;
+        result.errorInCommand = false;
+        int commandIndex = 0;
+        if (!priv::parseArgs(globals.view(), args, result, result.globals, &commandIndex)) {
+            return false;
+        }
+        result.commandIndex = commandIndex;
+        if (commandIndex == static_cast<int>(args.size())) {
+            result.error = ParseError::missingCommand;
+            result.errorIndex = commandIndex;
+            return false;
+        }
+        const uint32_t command = names.find(args[commandIndex]);
+        if (command == priv::npos) {
+            result.error = ParseError::unknownCommand;
+            result.errorIndex = commandIndex;
+            return false;
+        }
+        result.command = command;
+        const priv::ArgsTail<Args> tail{ args, static_cast<size_t>(commandIndex) };
+        if (!priv::parseArgs(commandOptions(command).view(), tail, result, result.values, nullptr)) {
+            result.errorInCommand = true;
+            result.errorIndex += commandIndex;
+            return false;
+        }
+        return true;
+    }
+
+    template <class Args>
+    bool Commands::tryParseMultiCallArgs(const Args & args, CommandResult & result) {
+        const uint32_t command = names.find(priv::calledName(args[0]));
+        if (command == priv::npos) {
+            return tryParseArgs(args, result);
+        }
+        // the global options keep their default values
+        result.command = priv::npos;
+        result.errorInCommand = false;
+        result.commandIndex = 0;
+        if (!priv::parseArgs(globals.view(), priv::ArgsHead<Args>{ args, 1 }, result, result.globals, nullptr)) {
+            return false;
+        }
+        result.command = command;
+        if (!priv::parseArgs(commandOptions(command).view(), args, result, result.values, nullptr)) {
+            result.errorInCommand = true;
+            return false;
+        }
+        return true;
+    }
+
+    template <class Args>
+    CommandResult Commands::parseOrExit(const Args & args, bool multiCall) {
+        CommandResult result;
+        if (multiCall ? tryParseMultiCallArgs(args, result) : tryParseArgs(args, result)) {
+            return result;
+        }
+        const std::string argv0(args[0]);
+        if (result.errorInCommand) {
+            // reported as if the command was the program
+            const priv::ArgsTail<Args> tail{ args, static_cast<size_t>(result.commandIndex) };
+            ParseStatus status = result;
+            status.errorIndex -= result.commandIndex;
+            const std::string command = (result.commandIndex == 0) ? argv0 : priv::extractProgramName(argv0) + " " + commands[result.command].name;
+            priv::exitOnError(commandOptions(result.command).view(), tail, status, command);
+        }
+        else if (result.error == ParseError::helpRequested) {
+            displayHelp(argv0);
+            std::cout.flush();
+            std::exit(0);
+        }
+        else if (result.error == ParseError::missingCommand || result.error == ParseError::unknownCommand) {
+            if (result.error == ParseError::missingCommand) {
+                std::cerr << "Error: missing command." << std::endl;
+            }
+            else {
+                std::cerr << "Error: unknown command '" << args[result.errorIndex] << "'." << std::endl;
+            }
+            displayHelp(argv0);
+            std::exit(1);
+        }
+        priv::exitOnError(globals.view(), args, result, argv0);
+        return result;
+    }
+
+    // options compiled at compile time: Options is a constexpr array of StaticOption, with static
+    // storage duration; errors in it (duplicated flag, bad flag...) make the compilation fail
+    template <const auto & Options>
+    class StaticSchema : public priv::SchemaFunctions<StaticSchema<Options>> {
+        static constexpr uint32_t optionCount = static_cast<uint32_t>(std::size(Options));
+        static constexpr uint32_t keyCount = priv::countKeys(std::data(Options), optionCount);
+        static constexpr uint32_t charCount = priv::countChars(std::data(Options), optionCount);
+        static constexpr uint32_t tableSize = priv::keyTableSize(keyCount);
+        static constexpr uint32_t bucketCount = priv::bucketCount(keyCount);
+
+    public:
+        constexpr StaticSchema() {
+            positionalIndex = priv::storeOptions(std::data(Options), optionCount, chars.data(), entries.data(), keys.data(), keyOptions.data());
+            priv::buildShortFlags(chars.data(), entries.data(), optionCount, keys.data(), shortFlags.data());
+            priv::buildPrefixTrie(chars.data(), entries.data(), optionCount, keys.data(), trie.data());
+            std::array<uint32_t, bucketCount + 1> bucketStarts{};
+            std::array<uint32_t, keyCount + 1> bucketKeys{};
+            priv::buildKeyTable(chars.data(), keys.data(), keyCount, keyTable.data(), tableSize,
+                                displacements.data(), bucketCount, bucketStarts.data(), bucketKeys.data());
+        }
+
+        // same as Parser::option(), but an unknown key stops the compilation when used to
+        // initialize a constexpr handle
+        constexpr OptionHandle option(std::string_view key) const {
+            const uint32_t index = view().findKey(key);
+            if (index == priv::npos) {
+                priv::schemaError("unknown option name or flag");
+            }
+            return OptionHandle{ index };
+        }
+
+    private:
+        friend class priv::SchemaFunctions<StaticSchema>;
+
+        constexpr priv::SchemaView view() const {
+            priv::SchemaView schema;
+            schema.chars = chars.data();
+            schema.options = entries.data();
+            schema.optionCount = optionCount;
+            schema.keys = keys.data();
+            schema.keyOptions = keyOptions.data();
+            schema.keyTable = keyTable.data();
+            schema.keyTableMask = tableSize - 1;
+            schema.displacements = displacements.data();
+            schema.bucketMask = bucketCount - 1;
+            schema.positionalIndex = positionalIndex;
+            schema.shortFlags = shortFlags.data();
+            schema.trie = trie.data();
+            return schema;
+        }
+
+        std::array<char, charCount> chars{};
+        std::array<priv::OptionEntry, optionCount> entries{};
+        std::array<priv::StringRef, keyCount> keys{};
+        std::array<uint32_t, keyCount> keyOptions{};
+        std::array<uint32_t, tableSize> keyTable{};
+        std::array<uint32_t, bucketCount> displacements{};
+        std::array<uint32_t, 256> shortFlags{};
+        std::array<priv::TrieNode, priv::countTrieNodes(std::data(Options), optionCount)> trie{};
+        uint32_t positionalIndex = priv::npos;
+    };
+
+    // option values with the configuration file they point into, shared through LiveOptions
+    struct OptionSnapshot {
+        OptionSnapshot() = default;
+        explicit OptionSnapshot(std::pmr::memory_resource * resource) : config(resource), result(resource) {}
+
+        ConfigFile config;
+        ParseResult result;
+    };
+
+    namespace priv {
+        // epoch in which a reader thread entered, 0 if it is not reading: a cache line per reader
+        // so that readers never write to the same memory
+        struct ReaderSlot {
+            alignas(64) std::atomic<uint64_t> epoch{ 0 };
+            std::atomic<bool> taken{ true };
+            ReaderSlot * next = nullptr;
+        };
+    }
+
+    // immutable snapshots of option values, read by many threads and replaced by publish() (epoch
+    // based reclamation): a read only writes the epoch of its own reader and loads the current
+    // snapshot, without lock nor shared counter; publish() waits for the reads of the previous
+    // snapshot to end before deleting it
+    class LiveOptions {
+    public:
+        explicit LiveOptions(std::unique_ptr<const OptionSnapshot> initial) : current(initial.release()) {
+            assert(current.load() != nullptr);
+        }
+        LiveOptions(const LiveOptions &) = delete;
+        LiveOptions & operator=(const LiveOptions &) = delete;
+        ~LiveOptions();
+
+        // snapshot being read: valid until destroyed, which must happen soon as it delays publish()
+        class ReadLock {
+        public:
+            ReadLock(const ReadLock &) = delete;
+            ReadLock & operator=(const ReadLock &) = delete;
+            ~ReadLock() { slot->epoch.store(0, std::memory_order_release); }
+
+            const OptionSnapshot & snapshot() const { return *current; }
+            const OptionValues & operator*() const { return current->result.values; }
+            const OptionValues * operator->() const { return &current->result.values; }
+
+        private:
+            friend class LiveOptions;
+            ReadLock(priv::ReaderSlot * slot, const OptionSnapshot * current) : slot(slot), current(current) {}
+
+            priv::ReaderSlot * slot;
+            const OptionSnapshot * current;
+        };
+
+        // registration of a reading thread, which keeps it for all its reads (one at a time)
+        class Reader {
+        public:
+            Reader(Reader && other) noexcept : live(other.live), slot(other.slot) { other.slot = nullptr; }
+            Reader & operator=(Reader &&) = delete;
+            ~Reader() {
+                if (slot) {
+                    slot->taken.store(false, std::memory_order_release);
+                }
+            }
+
+            ReadLock read() const {
+                assert(slot->epoch.load(std::memory_order_relaxed) == 0); // no nested read
+                // the epoch must be visible before loading the snapshot, so that publish() either
+                // sees this read or this read sees the new snapshot
+                slot->epoch.store(live->epoch.load());
+                return ReadLock(slot, live->current.load());
+            }
+
+        private:
+            friend class LiveOptions;
+            Reader(const LiveOptions * live, priv::ReaderSlot * slot) : live(live), slot(slot) {}
+
+            const LiveOptions * live;
+            priv::ReaderSlot * slot;
+        };
+
+        // may allocate the first time a thread registers
+        Reader reader();
+
+        // replace the snapshot (from the same Parser or StaticSchema) and return the options whose
+        // value or source changed; blocks until no thread reads the previous snapshot anymore, so
+        // it never returns if the calling thread holds a ReadLock
+        std::vector<OptionHandle> publish(std::unique_ptr<const OptionSnapshot> next);
+
+    private:
+        std::atomic<const OptionSnapshot *> current;
+        std::atomic<uint64_t> epoch{ 1 };
+        std::atomic<priv::ReaderSlot *> slots{ nullptr }; // never removed, reused by reader()
+        std::mutex publishing;
+    };
+
+    inline LiveOptions::~LiveOptions() {
+        for (priv::ReaderSlot * slot = slots.load(); slot != nullptr;) {
+            assert(!slot->taken.load()); // Reader outliving its LiveOptions
+            priv::ReaderSlot * next = slot->next;
+            delete slot;
+            slot = next;
+        }
+        delete current.load();
+    }
+
+    inline LiveOptions::Reader LiveOptions::reader() {
+        for (priv::ReaderSlot * slot = slots.load(); slot != nullptr; slot = slot->next) {
+            bool taken = false;
+            if (slot->taken.compare_exchange_strong(taken, true)) {
+                return Reader(this, slot);
+            }
+        }
+        priv::ReaderSlot * slot = new priv::ReaderSlot;
+        slot->next = slots.load();
+        while (!slots.compare_exchange_weak(slot->next, slot)) {
+        }
+        return Reader(this, slot);
+    }
+
+    inline std::vector<OptionHandle> LiveOptions::publish(std::unique_ptr<const OptionSnapshot> next) {
+        assert(next != nullptr);
+        std::lock_guard<std::mutex> lock(publishing);
+        const OptionSnapshot * previous = current.exchange(next.release());
+        const OptionValues & before = previous->result.values;
+        const OptionValues & after = current.load()->result.values;
+        assert(before.size() == after.size());
+
+        std::vector<OptionHandle> changed;
+        for (uint32_t i = 0; i < after.size(); ++i) {
+            const OptionHandle option{ i };
+            const ValueList oldValues = before.list(option), newValues = after.list(option);
+            if (before.source(option) != after.source(option) || before[option] != after[option] ||
+                !std::equal(oldValues.begin(), oldValues.end(), newValues.begin(), newValues.end())) {
+                changed.push_back(option);
+            }
+        }
+
+        // reads entered before the new epoch may still use the previous snapshot
+        const uint64_t newEpoch = epoch.fetch_add(1) + 1;
+        for (priv::ReaderSlot * slot = slots.load(); slot != nullptr; slot = slot->next) {
+            for (uint64_t readEpoch; (readEpoch = slot->epoch.load()) != 0 && readEpoch < newEpoch;) {
+                std::this_thread::yield();
+            }
+        }
+        delete previous;
+        return changed;
+    }
+
+    // flag looked for by prescan(): "--config", or { "--help", false } for a flag taking no value
+    struct PrescanFlag {
+        constexpr PrescanFlag(std::string_view flag, bool takesValue = true) : flag(flag), takesValue(takesValue) {}
+        constexpr PrescanFlag(const char * flag, bool takesValue = true) : flag(flag), takesValue(takesValue) {}
+
+        std::string_view flag;
+        bool takesValue;
+    };
+
+    // flag found by prescan()
+    struct PrescanMatch {
+        int index = -1;         // index of the flag in the arguments, -1 if not given
+        std::string_view value; // "--flag=value" or "--flag value", empty if none; "true" for a
+                                // flag taking no value given without "="
+
+        explicit operator bool() const { return index >= 0; }
+    };
+
+    namespace priv {
+        template <class Args, size_t N>
+        std::array<PrescanMatch, N> prescanArgs(const Args & args, const PrescanFlag (&flags)[N]) {
+            std::array<PrescanMatch, N> matches{};
+            const int argc = static_cast<int>(args.size());
+            size_t found = 0;
+            for (int i = 1; i < argc && found < N; ++i) {
+                const std::string_view arg = args[i];
+                if (arg.size() < 2 || arg.front() != '-') {
+                    continue;
+                }
+                std::string_view flag, value;
+                bool hasValue = false;
+                splitFlag(arg, flag, value, hasValue);
+                for (size_t f = 0; f < N; ++f) {
+                    if (flags[f].flag != flag || matches[f]) {
+                        continue;
+                    }
+                    matches[f].index = i;
+                    if (!hasValue && !flags[f].takesValue) {
+                        value = "true";
+                    }
+                    else if (!hasValue && i + 1 < argc && (args[i + 1].empty() || args[i + 1].front() != '-')) {
+                        value = args[++i];
+                    }
+                    matches[f].value = value;
+                    ++found;
+                    break;
+                }
+            }
+            return matches;
+        }
+    }
+
+    // look for a few flags without knowing the other options, e.g. "--config" to find the options
+    // themselves: argv is walked once without allocating, and matches[i] tells where flags[i] was
+    // first given; the value of a flag taking one is the next argument unless it starts with '-'
+    // (a value of an unknown option can then be taken for one of these flags), e.g.
+    // prescan(argc, argv, { "--config", { "--help", false } })
+    template <size_t N>
+    std::array<PrescanMatch, N> prescan(int argc, char *argv[], const PrescanFlag (&flags)[N]) {
+        return priv::prescanArgs(priv::ArgvList{ argc, argv }, flags);
+    }
+
+    template <size_t N>
+    std::array<PrescanMatch, N> prescan(const Arguments & args, const PrescanFlag (&flags)[N]) {
+        return priv::prescanArgs(args, flags);
+    }
+
+    // the returned map owns copies of the values, indexed by option name (without its "..." suffix)
+    // and by each flag; an option taking several values only gets its first one, the others being
+    // available through Parser and OptionValues::list()
+    inline std::map<std::string, std::string>
+    parse(int argc, char *argv[], std::vector<ProgramOption> options) {
+        const Parser parser(options);
+        const OptionValues values = parser.parse(argc, argv);
+        std::map<std::string, std::string> result;
+        for (const auto & opt : options) {
+            std::string name = opt.name;
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "...") == 0) {
+                name.resize(name.size() - 3);
+            }
+            const std::string_view value = values[name.empty() ? opt.flags.front() : name];
+            if (!name.empty()) {
+                result.emplace(name, value);
+            }
+            for (const auto & flag : opt.flags) {
+                result.emplace(flag, value);
+            }
+        }
         return result;
     }
 }
@@ -0,0 +1,474 @@
+/* This code is under MIT license.
+   See https://opensource.org/licenses/MIT
+
+   Tests of cmdline_parser.h: the steady state paths (parsing into a warm result, looking values
+   up, visiting) must not allocate, which is checked by counting the calls to operator new; the
+   main features are checked on small command lines.
+
+   Build and run (debug or release, the checks do not rely on assert):
+
+       g++ -std=c++17 -pthread -Iinclude test/allocation_test.cpp -o allocation_test
+       ./allocation_test
+
+   The program prints the failed checks and exits with status 1 if there is any.
+   LiveOptions is read by several threads while replaced: build with -fsanitize=thread (or
+   address) to check its reclamation too.
+*/
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cmdline_parser.h"
+
+// the replacements below pair malloc/free correctly, but GCC warns once they are inlined
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+    std::atomic<size_t> allocationCount{ 0 };
+    int failureCount = 0;
+}
+
+void * operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void * p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void * operator new[](size_t size) {
+    return operator new(size);
+}
+void * operator new(size_t size, std::align_val_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    const size_t align = static_cast<size_t>(alignment);
+    if (void * p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void * operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+void operator delete[](void * p) noexcept {
+    std::free(p);
+}
+void operator delete(void * p, size_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void * p, size_t) noexcept {
+    std::free(p);
+}
+void operator delete(void * p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void * p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void * p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void * p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+namespace {
+    void check(bool ok, const char * condition, int line) {
+        if (!ok) {
+            std::fprintf(stderr, "allocation_test.cpp:%d: check failed: %s\n", line, condition);
+            ++failureCount;
+        }
+    }
+
+    // argv owning its strings
+    struct CommandLine {
+        std::vector<std::string> strings;
+        std::vector<char *> argv;
+
+        CommandLine(std::initializer_list<const char *> args) : strings(args.begin(), args.end()) {
+            for (auto & arg : strings) {
+                argv.push_back(&arg[0]);
+            }
+            argv.push_back(nullptr);
+        }
+        CommandLine(const CommandLine &) = delete; // argv points into strings
+
+        int argc() const { return static_cast<int>(argv.size() - 1); }
+        char ** data() { return argv.data(); }
+    };
+
+    // number of allocations of op, once warmed up
+    template <class Op>
+    size_t allocations(Op && op) {
+        op();
+        const size_t before = allocationCount.load(std::memory_order_relaxed);
+        for (int i = 0; i < 3; ++i) {
+            op();
+        }
+        return allocationCount.load(std::memory_order_relaxed) - before;
+    }
+
+    static constexpr cmdline::StaticOption staticOptions[] = {
+        { "help", "Test program" },
+        { { "-o", "--output", "output" }, "Output file", "out.txt" },
+        { { "-l", "--level", "level" }, "Level", "1", cmdline::ValueType::integer },
+        { { "-v", "--verbose" }, "Verbose" },
+        { "input", "Input file" }
+    };
+    static constexpr cmdline::StaticSchema<staticOptions> staticSchema;
+
+    std::vector<cmdline::ProgramOption> testOptions() {
+        return {
+            { "help", "Test program" },
+            { "version", "1.0" },
+            { { "-o", "--output", "output" }, "Output file", "out.txt" },
+            { { "-l", "--level", "level" }, "Level", "1", cmdline::ValueType::integer },
+            { { "-m", "--mode", "mode" }, "Mode", "fast", cmdline::ValueType::oneOf("fast|slow") },
+            { { "-I", "include..." }, "Include path" },
+            { { "-D", "define..." }, "Definition" },
+            { { "-x", "--verbose" }, "Verbose" },
+            { { "--verbosity", "verbosity" }, "Verbosity", "0" },
+            { { "-q", "--quiet" }, "Quiet" },
+            { "input", "Input file" },
+            { "others...", "Other files", "none" }
+        };
+    }
+
+    void testAllocations() {
+        const cmdline::Parser parser(testOptions());
+        const cmdline::OptionHandle output = parser.option("output");
+        const cmdline::OptionHandle include = parser.option("include");
+        const cmdline::OptionHandle others = parser.option("others");
+        CommandLine commandLine{ "prog", "-I", "a", "in.txt", "-o=out", "-I", "b", "-xq", "--level", "3", "x", "y", "z" };
+        cmdline::ParseResult result;
+
+        CHECK(allocations([&] { parser.tryParse(commandLine.argc(), commandLine.data(), result); }) == 0);
+        CHECK(result.error == cmdline::ParseError::none);
+        CHECK(allocations([&] {
+            CHECK(result.values["--output"] == "out");
+            CHECK(result.values["output"] == "out");
+            CHECK(result.values[output] == "out");
+            CHECK(result.values.asInteger(parser.option("level")) == 3);
+            CHECK(result.values.asBool(parser.option("-x")));
+        }) == 0);
+        CHECK(allocations([&] {
+            const cmdline::ValueList includes = result.values.list(include);
+            CHECK(includes.size() == 2 && includes[0] == "a" && includes[1] == "b");
+            const cmdline::ValueList files = result.values.list(others);
+            CHECK(files.size() == 3 && files[0] == "x" && files[2] == "z");
+        }) == 0);
+
+        // values of repeated options interleaved on the command line, grouped after parsing
+        CommandLine interleaved{ "prog", "-I", "a", "-D", "x", "in.txt", "-I", "b", "-Ic", "-D=y" };
+        CHECK(allocations([&] { parser.tryParse(interleaved.argc(), interleaved.data(), result); }) == 0);
+        CHECK(result.error == cmdline::ParseError::none);
+        const cmdline::ValueList includes = result.values.list(include);
+        CHECK(includes.size() == 3 && includes[0] == "a" && includes[1] == "b" && includes[2] == "c");
+        const cmdline::ValueList defines = result.values.list("define");
+        CHECK(defines.size() == 2 && defines[0] == "x" && defines[1] == "y");
+
+        size_t visited = 0;
+        CHECK(allocations([&] {
+            visited = 0;
+            parser.visit(commandLine.argc(), commandLine.data(), [&](cmdline::OptionHandle, std::string_view) { ++visited; });
+        }) == 0);
+        CHECK(visited == 10);
+
+        CommandLine staticLine{ "prog", "-vl", "5", "in.txt" };
+        cmdline::ParseResult staticResult;
+        CHECK(allocations([&] { staticSchema.tryParse(staticLine.argc(), staticLine.data(), staticResult); }) == 0);
+        CHECK(staticResult.error == cmdline::ParseError::none);
+        CHECK(allocations([&] {
+            CHECK(staticResult.values[staticSchema.option("input")] == "in.txt");
+            CHECK(staticResult.values.asInteger(staticSchema.option("level")) == 5);
+            CHECK(staticResult.values["--output"] == "out.txt");
+        }) == 0);
+    }
+
+    cmdline::ParseError parseError(const cmdline::Parser & parser, CommandLine commandLine, int * errorIndex = nullptr) {
+        cmdline::ParseResult result;
+        parser.tryParse(commandLine.argc(), commandLine.data(), result);
+        if (errorIndex) {
+            *errorIndex = result.errorIndex;
+        }
+        return result.error;
+    }
+
+    void testErrors() {
+        using cmdline::ParseError;
+        const cmdline::Parser parser(testOptions());
+        int index = 0;
+        CHECK(parseError(parser, { "prog", "--nope", "in" }, &index) == ParseError::unknownOption && index == 1);
+        CHECK(parseError(parser, { "prog", "in", "-o" }, &index) == ParseError::missingValue && index == 2);
+        CHECK(parseError(parser, { "prog" }) == ParseError::missingPositional);
+        CHECK(parseError(parser, { "prog", "-h" }) == ParseError::helpRequested);
+        CHECK(parseError(parser, { "prog", "--version" }) == ParseError::versionRequested);
+        CHECK(parseError(parser, { "prog", "in", "-l", "abc" }) == ParseError::invalidValue);
+        CHECK(parseError(parser, { "prog", "in", "-l", "99999999999999999999" }) == ParseError::outOfRange);
+        CHECK(parseError(parser, { "prog", "in", "--mode=medium" }) == ParseError::invalidValue);
+        CHECK(parseError(parser, { "prog", "in", "--verb" }) == ParseError::ambiguousOption);
+        CHECK(parseError(parser, { "prog", "in", "-x", "-x" }, &index) == ParseError::duplicateOption && index == 3);
+        CHECK(parseError(parser, { "prog", "in", "-xx" }) == ParseError::duplicateOption);
+        CHECK(parseError(parser, { "prog", "in", "--qui", "--quiet" }) == ParseError::duplicateOption);
+        CHECK(parseError(parser, { "prog", "in", "-o", "a", "--output=b" }, &index) == ParseError::duplicateOption && index == 4);
+    }
+
+    void testSyntax() {
+        const cmdline::Parser parser(testOptions());
+        CommandLine commandLine{ "prog", "in", "-xqoout", "--verbosi=2", "--mode", "slow", "-Ia", "-I=b" };
+        const cmdline::ParseResult result = parser.tryParse(commandLine.argc(), commandLine.data());
+        CHECK(result.error == cmdline::ParseError::none);
+        CHECK(result.values["--verbose"] == "true" && result.values["-q"] == "true");
+        CHECK(result.values["output"] == "out");
+        CHECK(result.values["verbosity"] == "2");
+        CHECK(result.values.asChoice(parser.option("mode")) == 1);
+        const cmdline::ValueList includes = result.values.list("include");
+        CHECK(includes.size() == 2 && includes[0] == "a" && includes[1] == "b");
+        CHECK(result.values["others"] == "none" && result.values.list("others").size() == 1);
+        CHECK(result.values.source(parser.option("output")) == cmdline::ValueSource::commandLine);
+        CHECK(result.values.source(parser.option("level")) == cmdline::ValueSource::defaultValue);
+
+        const std::vector<std::string_view> candidates = parser.candidates("--verb");
+        CHECK(candidates.size() == 2 && candidates[0] == "--verbose" && candidates[1] == "--verbosity");
+    }
+
+    // cmdline::parse(), returning copies in a map
+    void testMapParse() {
+        CommandLine commandLine{ "prog", "in1", "in2" };
+        std::map<std::string, std::string> values = cmdline::parse(commandLine.argc(), commandLine.data(), { { "inputs...", "Inputs" } });
+        CHECK(values.count("inputs...") == 0);
+        CHECK(values["inputs"] == "in1");
+
+        CommandLine includes{ "prog", "-I", "x", "-I", "y" };
+        values = cmdline::parse(includes.argc(), includes.data(), { { { "-I", "include..." }, "Include path" } });
+        CHECK(values.count("include...") == 0);
+        CHECK(values["include"] == "x" && values["-I"] == "x");
+    }
+
+    void testResponseFiles() {
+        const std::filesystem::path directory = std::filesystem::temp_directory_path();
+        const std::string first = (directory / "cmdline_parser_test_1.rsp").string();
+        const std::string second = (directory / "cmdline_parser_test_2.rsp").string();
+        std::ofstream(first) << "-o 'my output' @" << second << "\n\"in put\"";
+        std::ofstream(second) << "-I a\\ b\n-x";
+
+        const std::string responseFile = "@" + first;
+        CommandLine commandLine{ "prog", responseFile.c_str(), "z" };
+        cmdline::Arguments args;
+        CHECK(args.tryExpand(commandLine.argc(), commandLine.data()).error == cmdline::ParseError::none);
+        CHECK(args.size() == 8);
+        const cmdline::Parser parser(testOptions());
+        const cmdline::ParseResult result = parser.tryParse(args);
+        CHECK(result.error == cmdline::ParseError::none);
+        CHECK(result.values["output"] == "my output");
+        CHECK(result.values["include"] == "a b");
+        CHECK(result.values["input"] == "in put");
+        CHECK(result.values["others"] == "z");
+
+        CHECK(args.argvIndex(0) == 0 && args.argvIndex(1) == 1 && args.argvIndex(6) == 1);
+        CHECK(args.argvIndex(7) == 2 && args.argvIndex(8) == 3);
+
+        // errors are located in the Arguments, argvIndex() gives the argument of argv
+        CommandLine unknown{ "prog", responseFile.c_str(), "--nope" };
+        CHECK(args.tryExpand(unknown.argc(), unknown.data()).error == cmdline::ParseError::none);
+        const cmdline::ParseResult failed = parser.tryParse(args);
+        CHECK(failed.error == cmdline::ParseError::unknownOption && failed.errorIndex == 7);
+        CHECK(args[failed.errorIndex] == "--nope" && args.argvIndex(failed.errorIndex) == 2);
+
+        std::ofstream(second) << "@" << first;
+        CHECK(args.tryExpand(commandLine.argc(), commandLine.data()).error == cmdline::ParseError::responseFileCycle);
+        std::filesystem::remove(first);
+        std::filesystem::remove(second);
+    }
+
+    void testLayers() {
+        const cmdline::Parser parser(testOptions());
+        std::string level = "TEST_LEVEL=4", mode = "TEST_MODE=slow", other = "OTHER_OUTPUT=x";
+        char * variables[] = { &level[0], &mode[0], &other[0], nullptr };
+        const cmdline::Environment environment{ "TEST_", variables };
+        const std::string path = (std::filesystem::temp_directory_path() / "cmdline_parser_test.ini").string();
+        std::ofstream(path) << "# settings\n[main]\nlevel = 7\n--verbosity = 3\n\noutput = from file\n";
+        cmdline::ConfigFile config;
+        CHECK(config.tryLoad(path).error == cmdline::ParseError::none && config.size() == 3);
+
+        CommandLine commandLine{ "prog", "in", "--mode", "fast" };
+        cmdline::ParseResult result;
+        CHECK(parser.tryParse(commandLine.argc(), commandLine.data(), cmdline::Layers{ &environment, &config }, result));
+        CHECK(result.values.asChoice(parser.option("mode")) == 0);
+        CHECK(result.values.source(parser.option("mode")) == cmdline::ValueSource::commandLine);
+        CHECK(result.values.asInteger(parser.option("level")) == 4);
+        CHECK(result.values.source(parser.option("level")) == cmdline::ValueSource::environment);
+        CHECK(result.values["verbosity"] == "3" && result.values["output"] == "from file");
+        CHECK(result.values.source(parser.option("output")) == cmdline::ValueSource::configFile);
+
+        std::ofstream(path) << "level = 1\nunknown = 2\n";
+        CHECK(config.tryLoad(path).error == cmdline::ParseError::none);
+        CHECK(!parser.tryParse(commandLine.argc(), commandLine.data(), cmdline::Layers{ nullptr, &config }, result));
+        CHECK(result.error == cmdline::ParseError::unknownOption && result.errorIndex == 2);
+        CHECK(result.errorSource == cmdline::ValueSource::configFile);
+
+        // options taking several values get all the values of the first layer giving them
+        std::ofstream(path) << "include = a\ndefine = x\ninclude = b\n-I = c\ndefine = y\n";
+        CHECK(config.tryLoad(path).error == cmdline::ParseError::none);
+        CHECK(parser.tryParse(commandLine.argc(), commandLine.data(), cmdline::Layers{ nullptr, &config }, result));
+        const cmdline::ValueList includes = result.values.list("include");
+        CHECK(includes.size() == 3 && includes[0] == "a" && includes[1] == "b" && includes[2] == "c");
+        const cmdline::ValueList defines = result.values.list("define");
+        CHECK(defines.size() == 2 && defines[0] == "x" && defines[1] == "y");
+        CHECK(result.values.source(parser.option("include")) == cmdline::ValueSource::configFile);
+        CommandLine withInclude{ "prog", "in", "-I", "z" };
+        CHECK(parser.tryParse(withInclude.argc(), withInclude.data(), cmdline::Layers{ nullptr, &config }, result));
+        CHECK(result.values.list("include").size() == 1 && result.values.list("include")[0] == "z");
+        CHECK(result.values.list("define").size() == 2);
+
+        std::ofstream(path) << "level = 1\n--level = 2\n";
+        CHECK(config.tryLoad(path).error == cmdline::ParseError::none);
+        CHECK(!parser.tryParse(commandLine.argc(), commandLine.data(), cmdline::Layers{ nullptr, &config }, result));
+        CHECK(result.error == cmdline::ParseError::duplicateOption && result.errorIndex == 2);
+
+        std::ofstream(path) << "level = 1\nno value\n";
+        const cmdline::ParseStatus status = config.tryLoad(path);
+        CHECK(status.error == cmdline::ParseError::invalidSetting && status.errorIndex == 2);
+        std::filesystem::remove(path);
+    }
+
+    void testCommands() {
+        const std::vector<cmdline::Command> commandList = {
+            { "copy", "Copy a file", [] { return std::vector<cmdline::ProgramOption>{ { "from", "Source" }, { "to", "Destination" } }; } },
+            { "remove", "Remove a file", [] { return std::vector<cmdline::ProgramOption>{ { { "-f", "--force" }, "Force" }, { "file", "File" } }; } }
+        };
+        cmdline::Commands commands({ { "help", "Test program" }, { { "-x", "--verbose" }, "Verbose" } }, commandList);
+
+        CommandLine commandLine{ "tool", "-x", "remove", "-f", "a.txt" };
+        cmdline::CommandResult result;
+        CHECK(commands.tryParse(commandLine.argc(), commandLine.data(), result));
+        CHECK(result.command == 1 && result.commandIndex == 2);
+        CHECK(result.globals["--verbose"] == "true");
+        CHECK(result.values["--force"] == "true" && result.values["file"] == "a.txt");
+
+        CommandLine unknown{ "tool", "move" };
+        CHECK(!commands.tryParse(unknown.argc(), unknown.data(), result) && result.error == cmdline::ParseError::unknownCommand);
+        CommandLine missing{ "tool", "-x" };
+        CHECK(!commands.tryParse(missing.argc(), missing.data(), result) && result.error == cmdline::ParseError::missingCommand);
+
+        CommandLine multiCall{ "/usr/bin/copy", "a", "b" };
+        CHECK(commands.tryParseMultiCall(multiCall.argc(), multiCall.data(), result));
+        CHECK(result.command == 0 && result.values["from"] == "a" && result.values["to"] == "b");
+    }
+
+    void testBatch() {
+        const cmdline::Parser parser(testOptions());
+        std::vector<std::vector<std::string_view>> lines(1000, { "prog", "in", "-l", "2" });
+        lines[500] = { "prog", "in", "-l", "bad" };
+        std::vector<cmdline::ParseResult> results(lines.size());
+        CHECK(parser.parseBatch(lines, results.data(), 4) == 1);
+        CHECK(results[499].values.asInteger(parser.option("level")) == 2);
+        CHECK(results[500].error == cmdline::ParseError::invalidValue);
+    }
+
+    void testLiveOptions() {
+        const cmdline::Parser parser(testOptions());
+        const cmdline::OptionHandle output = parser.option("output");
+        const cmdline::OptionHandle level = parser.option("level");
+        const cmdline::OptionHandle include = parser.option("include");
+        CommandLine commandLine{ "prog", "in" };
+        // output changes value, level only changes source ("1" is its default), include its list
+        const auto makeSnapshot = [&](int version) {
+            auto snapshot = std::make_unique<cmdline::OptionSnapshot>();
+            snapshot->config.add("output", (version % 2) ? "odd" : "even");
+            if (version > 0) {
+                snapshot->config.add("level", "1");
+                snapshot->config.add("include", "a");
+            }
+            if (version > 1) {
+                snapshot->config.add("include", "b");
+            }
+            parser.tryParse(commandLine.argc(), commandLine.data(), cmdline::Layers{ nullptr, &snapshot->config }, snapshot->result);
+            return std::unique_ptr<const cmdline::OptionSnapshot>(std::move(snapshot));
+        };
+
+        cmdline::LiveOptions live(makeSnapshot(0));
+        std::vector<cmdline::OptionHandle> changed = live.publish(makeSnapshot(1));
+        CHECK(changed.size() == 3 && changed[0].index == output.index && changed[1].index == level.index && changed[2].index == include.index);
+        changed = live.publish(makeSnapshot(2));
+        CHECK(changed.size() == 2 && changed[0].index == output.index && changed[1].index == include.index);
+        changed = live.publish(makeSnapshot(2));
+        CHECK(changed.empty());
+        {
+            const cmdline::LiveOptions::Reader reader = live.reader();
+            const auto values = reader.read();
+            CHECK((*values)[output] == "even" && values->list(include).size() == 2);
+            CHECK(values->source(level) == cmdline::ValueSource::configFile);
+        }
+
+        // readers checking that each snapshot they see is consistent while it is replaced
+        std::atomic<bool> stop{ false };
+        std::atomic<int> inconsistent{ 0 };
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&] {
+                const cmdline::LiveOptions::Reader reader = live.reader();
+                while (!stop.load()) {
+                    const auto values = reader.read();
+                    const bool even = ((*values)[output] == "even");
+                    inconsistent += (values->list(include).size() == (even ? 2u : 1u)) ? 0 : 1;
+                }
+            });
+        }
+        for (int version = 0; version < 200; ++version) {
+            live.publish(makeSnapshot(version % 2 ? 1 : 2));
+        }
+        stop = true;
+        for (auto & reader : readers) {
+            reader.join();
+        }
+        CHECK(inconsistent == 0);
+    }
+
+    void testPrescan() {
+        CommandLine commandLine{ "prog", "in", "--config=a.ini", "--log-level", "debug", "-o", "x" };
+        const auto matches = cmdline::prescan(commandLine.argc(), commandLine.data(), { "--config", "--log-level", "--missing" });
+        CHECK(matches[0].index == 2 && matches[0].value == "a.ini");
+        CHECK(matches[1].index == 3 && matches[1].value == "debug");
+        CHECK(!matches[2]);
+
+        CommandLine help{ "prog", "--help", "in", "--verbose=no" };
+        const auto flags = cmdline::prescan(help.argc(), help.data(), { { "--help", false }, { "--verbose", false } });
+        CHECK(flags[0].index == 1 && flags[0].value == "true");
+        CHECK(flags[1].index == 3 && flags[1].value == "no");
+        CHECK(allocations([&] { cmdline::prescan(commandLine.argc(), commandLine.data(), { "--config", "--log-level" }); }) == 0);
+    }
+}
+
+int main() {
+    testAllocations();
+    testErrors();
+    testSyntax();
+    testMapParse();
+    testResponseFiles();
+    testLayers();
+    testCommands();
+    testBatch();
+    testLiveOptions();
+    testPrescan();
+    if (failureCount != 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failureCount);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}